@@ -3,17 +3,88 @@ import sys
 import inspect 
 import argparse
 import json
+import os
 import time
 
 CRED = '\033[91m'
 CGREEN  = '\33[32m'
 CEND = '\033[0m'
 
-def test_rtl_test():
+# the small dense layers and one small layer per layer mode, the sparse and
+# Winograd ones need SPARSE_ARRAY and WINOGRAD builds
+mode_layers = ["./layers/small_layer1.json", "./layers/small_layer2.json", "./layers/small_layer3.json", "./layers/small_requantize.json", "./layers/small_padding.json", "./layers/small_batch.json", "./layers/small_depthwise.json", "./layers/small_gemm.json", "./layers/small_residual.json", "./layers/small_pooling.json", "./layers/small_int4.json", "./layers/small_compressed.json"]
+sparse_layers = ["./layers/small_sparse.json"]
+winograd_layers = ["./layers/small_winograd.json"]
+# a layer the design rejects, see PARAMS_STATUS_OK in src/conv.h
+rejected_layers = ["./layers/small_rejected.json"]
+
+def expand_layers():
     if "all" == args.layers[0]:
         args.layers = ["./layers/resnet_conv1_params.json", "./layers/resnet_conv2_x_params.json", "./layers/resnet_conv3_1_params.json", "./layers/resnet_conv3_x_params.json", "./layers/resnet_conv4_1_params.json", "./layers/resnet_conv4_x_params.json", "./layers/resnet_conv5_1_params.json", "./layers/resnet_conv5_x_params.json"]
     elif "small" == args.layers[0]:
         args.layers = ["./layers/small_layer1.json", "./layers/small_layer2.json", "./layers/small_layer3.json"]
+    elif "modes" == args.layers[0]:
+        args.layers = mode_layers
+
+# runs the layers through a single build of the fast C testbench, returns its output
+def run_c_fast_test(layers, queue, sparse, winograd):
+    process = subprocess.run(['make', 'clean'],
+                             stdout=subprocess.PIPE if not verbose else None,
+                             stderr=subprocess.PIPE if not verbose else None)
+
+    layers = " ".join(os.path.abspath(layer) for layer in layers)
+    process = subprocess.run(['make', 'c_fast_test', f'''LAYERS={layers}''', f'''QUEUE={int(queue)}''', f'''SPARSE_ARRAY={int(sparse)}''', f'''WINOGRAD={int(winograd)}'''], 
+                             stdout=subprocess.PIPE, 
+                             universal_newlines=True)
+
+    if verbose:
+        print(process.stdout)
+
+    return process.stdout
+
+# writes the layer into src/conv_tb_params.h, the layer run by the per-layer builds
+def write_layer_params(data):
+    param_str_c = f'''const int IC0 = {data["IC0"]};
+const int OC0 = {data["OC0"]};
+const int IC1 = {data["IC1"]};
+const int OC1 = {data["OC1"]};
+const int FX = {data["FX"]};
+const int FY = {data["FY"]};
+const int OX0 = {data["OX0"]};
+const int OY0 = {data["OY0"]};
+const int OX1 = {data["OX1"]};
+const int OY1 = {data["OY1"]};
+const int STRIDE = {data["STRIDE"]}; 
+const int LOOP_ORDER = {data.get("LOOP_ORDER", 0)};
+const int RELU = {data.get("RELU", 0)};
+const int REQUANTIZE = {data.get("REQUANTIZE", 0)};
+const int PAD_TOP = {data.get("PAD_TOP", 0)};
+const int PAD_BOTTOM = {data.get("PAD_BOTTOM", 0)};
+const int PAD_LEFT = {data.get("PAD_LEFT", 0)};
+const int PAD_RIGHT = {data.get("PAD_RIGHT", 0)};
+const int N = {data.get("N", 1)};
+const int CONV_MODE = {data.get("CONV_MODE", 0)};
+const int RESIDUAL = {data.get("RESIDUAL", 0)};
+const int RESIDUAL_SHIFT = {data.get("RESIDUAL_SHIFT", 0)};
+const int POOL = {data.get("POOL", 0)};
+const int POOL_SIZE = {data.get("POOL_SIZE", 1)};
+const int POOL_STRIDE = {data.get("POOL_STRIDE", 1)};
+const int POOL_PAD = {data.get("POOL_PAD", 0)};
+const int POOL_SCALE = {data.get("POOL_SCALE", (2 ** data.get("POOL_SHIFT", 15) + data.get("POOL_SIZE", 1) ** 2 // 2) // data.get("POOL_SIZE", 1) ** 2)};
+const int POOL_SHIFT = {data.get("POOL_SHIFT", 15)};
+const int PRECISION = {data.get("PRECISION", 0)};
+const int SPARSE = {data.get("SPARSE", 0)};
+const int WEIGHT_COMPRESSION = {data.get("WEIGHT_COMPRESSION", 0)};
+'''
+
+    with open("./src/conv_tb_params.h", "w") as output:
+        output.write(param_str_c)
+
+    if (verbose):
+        print(f'Layer params: IC0={data["IC0"]} OC0={data["OC0"]} IC1={data["IC1"]} OC1={data["OC1"]} FX={data["FX"]} FY={data["FY"]} OX0={data["OX0"]} OY0={data["OY0"]} OX1={data["OX1"]} OY1={data["OY1"]} STRIDE={data["STRIDE"]}')
+
+def test_rtl_test():
+    expand_layers()
 
     run = 0
     passed = 0
@@ -40,24 +111,7 @@ def test_rtl_test():
         with open(layer) as f:
             data = json.load(f)
 
-        param_str_c = f'''const int IC0 = {data["IC0"]};
-const int OC0 = {data["OC0"]};
-const int IC1 = {data["IC1"]};
-const int OC1 = {data["OC1"]};
-const int FX = {data["FX"]};
-const int FY = {data["FY"]};
-const int OX0 = {data["OX0"]};
-const int OY0 = {data["OY0"]};
-const int OX1 = {data["OX1"]};
-const int OY1 = {data["OY1"]};
-const int STRIDE = {data["STRIDE"]}; 
-'''
-
-        with open("./src/conv_tb_params.h", "w") as output:
-            output.write(param_str_c)
-
-        if (verbose):
-            print(f'Layer params: IC0={data["IC0"]} OC0={data["OC0"]} IC1={data["IC1"]} OC1={data["OC1"]} FX={data["FX"]} FY={data["FY"]} OX0={data["OX0"]} OY0={data["OY0"]} OX1={data["OX1"]} OY1={data["OY1"]} STRIDE={data["STRIDE"]}')
+        write_layer_params(data)
 
         process = subprocess.run(['make'], 
                          stdout=subprocess.PIPE if not verbose else None,
@@ -92,11 +146,7 @@ const int STRIDE = {data["STRIDE"]};
     return run, passed
 
 def test_c_weight_test():
-    if "all" == args.layers[0]:
-        args.layers = ["./layers/resnet_conv1_params.json", "./layers/resnet_conv2_x_params.json", "./layers/resnet_conv3_1_params.json", "./layers/resnet_conv3_x_params.json", "./layers/resnet_conv4_1_params.json", "./layers/resnet_conv4_x_params.json", "./layers/resnet_conv5_1_params.json", "./layers/resnet_conv5_x_params.json"]
-    elif "small" == args.layers[0]:
-        args.layers = ["./layers/small_layer1.json", "./layers/small_layer2.json", "./layers/small_layer3.json"]
-
+    expand_layers()
 
     run = 0
     passed = 0
@@ -116,24 +166,7 @@ def test_c_weight_test():
         compare_filename = compare_filename.replace(".json", "_weight_gold")
         compare_filename = "../" + compare_filename
 
-        param_str_c = f'''const int IC0 = {data["IC0"]};
-const int OC0 = {data["OC0"]};
-const int IC1 = {data["IC1"]};
-const int OC1 = {data["OC1"]};
-const int FX = {data["FX"]};
-const int FY = {data["FY"]};
-const int OX0 = {data["OX0"]};
-const int OY0 = {data["OY0"]};
-const int OX1 = {data["OX1"]};
-const int OY1 = {data["OY1"]};
-const int STRIDE = {data["STRIDE"]}; 
-'''
-
-        with open("./src/conv_tb_params.h", "w") as output:
-            output.write(param_str_c)
-
-        if (verbose):
-            print(f'Layer params: IC0={data["IC0"]} OC0={data["OC0"]} IC1={data["IC1"]} OC1={data["OC1"]} FX={data["FX"]} FY={data["FY"]} OX0={data["OX0"]} OY0={data["OY0"]} OX1={data["OX1"]} OY1={data["OY1"]} STRIDE={data["STRIDE"]}')
+        write_layer_params(data)
 
     
         process = subprocess.run(['make', 'weight_c_test', f'''COMPARE_FILE={compare_filename}'''], 
@@ -154,11 +187,7 @@ const int STRIDE = {data["STRIDE"]};
     return run, passed
 
 def test_c_input_test():
-    if "all" == args.layers[0]:
-        args.layers = ["./layers/resnet_conv1_params.json", "./layers/resnet_conv2_x_params.json", "./layers/resnet_conv3_1_params.json", "./layers/resnet_conv3_x_params.json", "./layers/resnet_conv4_1_params.json", "./layers/resnet_conv4_x_params.json", "./layers/resnet_conv5_1_params.json", "./layers/resnet_conv5_x_params.json"]
-    elif "small" == args.layers[0]:
-        args.layers = ["./layers/small_layer1.json", "./layers/small_layer2.json", "./layers/small_layer3.json"]
-
+    expand_layers()
 
     run = 0
     passed = 0
@@ -178,24 +207,7 @@ def test_c_input_test():
         compare_filename = compare_filename.replace(".json", "_input_gold")
         compare_filename = "../" + compare_filename
 
-        param_str_c = f'''const int IC0 = {data["IC0"]};
-const int OC0 = {data["OC0"]};
-const int IC1 = {data["IC1"]};
-const int OC1 = {data["OC1"]};
-const int FX = {data["FX"]};
-const int FY = {data["FY"]};
-const int OX0 = {data["OX0"]};
-const int OY0 = {data["OY0"]};
-const int OX1 = {data["OX1"]};
-const int OY1 = {data["OY1"]};
-const int STRIDE = {data["STRIDE"]}; 
-'''
-
-        with open("./src/conv_tb_params.h", "w") as output:
-            output.write(param_str_c)
-
-        if (verbose):
-            print(f'Layer params: IC0={data["IC0"]} OC0={data["OC0"]} IC1={data["IC1"]} OC1={data["OC1"]} FX={data["FX"]} FY={data["FY"]} OX0={data["OX0"]} OY0={data["OY0"]} OX1={data["OX1"]} OY1={data["OY1"]} STRIDE={data["STRIDE"]}')
+        write_layer_params(data)
 
     
         process = subprocess.run(['make', 'input_c_test', f'''COMPARE_FILE={compare_filename}'''], 
@@ -216,55 +228,87 @@ const int STRIDE = {data["STRIDE"]};
     return run, passed
 
 def test_c_fast_test():
-    if "all" == args.layers[0]:
-        args.layers = ["./layers/resnet_conv1_params.json", "./layers/resnet_conv2_x_params.json", "./layers/resnet_conv3_1_params.json", "./layers/resnet_conv3_x_params.json", "./layers/resnet_conv4_1_params.json", "./layers/resnet_conv4_x_params.json", "./layers/resnet_conv5_1_params.json", "./layers/resnet_conv5_x_params.json"]
-    elif "small" == args.layers[0]:
-        args.layers = ["./layers/small_layer1.json", "./layers/small_layer2.json", "./layers/small_layer3.json"]
+    expand_layers()
 
+    # the testbench reads the layer files at runtime, so it is built once and
+    # sweeps all layers in a single run
+    print("Running c_test with layer params:", " ".join(args.layers))
+
+    stdout = run_c_fast_test(args.layers, queue, sparse, winograd)
 
     run = 0
     passed = 0
     for layer in args.layers:
-        print("Running c_test with layer params:", layer)
+        if f"Layer {os.path.abspath(layer)}: PASSED" in stdout:
+            print(CGREEN + "Test passed! " + layer + "\n" + CEND)
+            run += 1
+            passed += 1
+        else:
+            print(CRED + "Test failed " + layer + "\n" + CEND)
+            run += 1
+            passed += 0
 
-        process = subprocess.run(['make', 'clean'],
-                                 stdout=subprocess.PIPE if not verbose else None,
-                                 stderr=subprocess.PIPE if not verbose else None)
+    
+    return run, passed
 
-        with open(layer) as f:
-            data = json.load(f)
+def test_c_modes_test():
+    # the mode layers one by one, then as one descriptor queue with a rejected
+    # layer in the middle, which the design reports and skips
+    runs = [(mode_layers, False, False, False, []),
+            (mode_layers[:5] + rejected_layers + mode_layers[5:], True, False, False, rejected_layers),
+            (sparse_layers, False, True, False, []),
+            (winograd_layers, False, False, True, [])]
 
-        param_str_c = f'''const int IC0 = {data["IC0"]};
-const int OC0 = {data["OC0"]};
-const int IC1 = {data["IC1"]};
-const int OC1 = {data["OC1"]};
-const int FX = {data["FX"]};
-const int FY = {data["FY"]};
-const int OX0 = {data["OX0"]};
-const int OY0 = {data["OY0"]};
-const int OX1 = {data["OX1"]};
-const int OY1 = {data["OY1"]};
-const int STRIDE = {data["STRIDE"]}; 
-'''
+    run = 0
+    passed = 0
+    for layers, run_queue, run_sparse, run_winograd, rejected in runs:
+        print("Running modes c_test with layer params:", " ".join(layers))
 
-        with open("./src/conv_tb_params.h", "w") as output:
-            output.write(param_str_c)
+        stdout = run_c_fast_test(layers, run_queue, run_sparse, run_winograd)
 
-        if (verbose):
-            print(f'Layer params: IC0={data["IC0"]} OC0={data["OC0"]} IC1={data["IC1"]} OC1={data["OC1"]} FX={data["FX"]} FY={data["FY"]} OX0={data["OX0"]} OY0={data["OY0"]} OX1={data["OX1"]} OY1={data["OY1"]} STRIDE={data["STRIDE"]}')
+        for layer in layers:
+            result = f"Layer {os.path.abspath(layer)}: PASSED" in stdout
+            if layer in rejected:
+                result = f"Layer {os.path.abspath(layer)}: FAILED" in stdout and "Layer rejected" in stdout
+            if result:
+                print(CGREEN + "Test passed! " + layer + "\n" + CEND)
+                run += 1
+                passed += 1
+            else:
+                print(CRED + "Test failed " + layer + "\n" + CEND)
+                run += 1
+                passed += 0
 
-    
-        process = subprocess.run(['make', 'c_fast_test'], 
-                         stdout=subprocess.PIPE if not verbose else None,
-                         stderr=subprocess.PIPE if not verbose else None)
+    return run, passed
 
+def test_c_functional_test():
+    expand_layers()
 
-        if process.returncode == 0:
-            print(CGREEN + "Test passed!\n" + CEND)
+    # the testbench reads the layer files at runtime, so it is built once and
+    # sweeps all layers in a single run
+    print("Running functional c_test with layer params:", " ".join(args.layers))
+
+    process = subprocess.run(['make', 'clean'],
+                             stdout=subprocess.PIPE if not verbose else None,
+                             stderr=subprocess.PIPE if not verbose else None)
+
+    layers = " ".join(os.path.abspath(layer) for layer in args.layers)
+    process = subprocess.run(['make', 'c_functional_test', f'''LAYERS={layers}''', f'''QUEUE={int(queue)}''', f'''SPARSE_ARRAY={int(sparse)}''', f'''WINOGRAD={int(winograd)}'''], 
+                             stdout=subprocess.PIPE, 
+                             universal_newlines=True)
+
+    if verbose:
+        print(process.stdout)
+
+    run = 0
+    passed = 0
+    for layer in args.layers:
+        if f"Layer {os.path.abspath(layer)}: PASSED" in process.stdout:
+            print(CGREEN + "Test passed! " + layer + "\n" + CEND)
             run += 1
             passed += 1
         else:
-            print(CRED + "Test failed\n" + CEND)
+            print(CRED + "Test failed " + layer + "\n" + CEND)
             run += 1
             passed += 0
 
@@ -272,11 +316,7 @@ const int STRIDE = {data["STRIDE"]};
     return run, passed
 
 def test_c_test():
-    if "all" == args.layers[0]:
-        args.layers = ["./layers/resnet_conv1_params.json", "./layers/resnet_conv2_x_params.json", "./layers/resnet_conv3_1_params.json", "./layers/resnet_conv3_x_params.json", "./layers/resnet_conv4_1_params.json", "./layers/resnet_conv4_x_params.json", "./layers/resnet_conv5_1_params.json", "./layers/resnet_conv5_x_params.json"]
-    elif "small" == args.layers[0]:
-        args.layers = ["./layers/small_layer1.json", "./layers/small_layer2.json", "./layers/small_layer3.json"]
-
+    expand_layers()
 
     run = 0
     passed = 0
@@ -290,24 +330,7 @@ def test_c_test():
         with open(layer) as f:
             data = json.load(f)
 
-        param_str_c = f'''const int IC0 = {data["IC0"]};
-const int OC0 = {data["OC0"]};
-const int IC1 = {data["IC1"]};
-const int OC1 = {data["OC1"]};
-const int FX = {data["FX"]};
-const int FY = {data["FY"]};
-const int OX0 = {data["OX0"]};
-const int OY0 = {data["OY0"]};
-const int OX1 = {data["OX1"]};
-const int OY1 = {data["OY1"]};
-const int STRIDE = {data["STRIDE"]}; 
-'''
-
-        with open("./src/conv_tb_params.h", "w") as output:
-            output.write(param_str_c)
-
-        if (verbose):
-            print(f'Layer params: IC0={data["IC0"]} OC0={data["OC0"]} IC1={data["IC1"]} OC1={data["OC1"]} FX={data["FX"]} FY={data["FY"]} OX0={data["OX0"]} OY0={data["OY0"]} OX1={data["OX1"]} OY1={data["OY1"]} STRIDE={data["STRIDE"]}')
+        write_layer_params(data)
 
     
         process = subprocess.run(['make', 'c_test'], 
@@ -335,12 +358,18 @@ parser.add_argument("-l", "--layers", type=str, nargs='*', help='Layer specifica
 parser.add_argument("--list", action="store_true", help='List all tests')
 parser.add_argument("-v", "--verbose", action="store_true", help='Verbose option for printing test output')
 parser.add_argument("-n", "--no_build", action="store_true", help='Option for not rebuilding when running RTL tests')
+parser.add_argument("-q", "--queue", action="store_true", help='Run the layers back to back as one descriptor queue in the C tests')
+parser.add_argument("-s", "--sparse", action="store_true", help='Build the C tests with the array widened for sparse layers')
+parser.add_argument("-w", "--winograd", action="store_true", help='Build the C tests with the array widened for Winograd layers')
 
 args = parser.parse_args()
 
 
 verbose = args.verbose
 no_build = args.no_build
+queue = args.queue
+sparse = args.sparse
+winograd = args.winograd
 
 all_tests = [obj for name,obj in inspect.getmembers(sys.modules[__name__]) 
                         if (inspect.isfunction(obj) and 
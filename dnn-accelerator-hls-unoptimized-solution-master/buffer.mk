@@ -2,27 +2,51 @@ CATAPULT = /cad/mentor/2019.11/Catapult_Synthesis_10.4b-841621/Mgc_home/bin/cata
 MGC_HOME = /cad/mentor/2019.11/Catapult_Synthesis_10.4b-841621/Mgc_home
 CC = $(MGC_HOME)/bin/g++
 CFLAGS += -g -std=c++11
+# conv_gold_fast: AVX2 dot products and OpenMP threads over the output rows
+# CROSS_CHECK=1 also runs the naive conv_gold / conv_gold_tiled models
+CROSS_CHECK ?= 0
+# SPARSE_ARRAY=1 builds the array for 2:4 sparse layers (Params.SPARSE)
+SPARSE_ARRAY ?= 0
+# WINOGRAD=1 builds the array for Winograd layers (Params.CONV_MODE WINOGRAD)
+WINOGRAD ?= 0
+TB_CFLAGS = -O2 -march=native -fopenmp -DCONV_GOLD_CROSS_CHECK=$(CROSS_CHECK) -DSPARSE_ARRAY=$(SPARSE_ARRAY) -DWINOGRAD=$(WINOGRAD)
+# layer json files swept by a single conv_tb run; with none the layer in conv_tb_params.h is run
+LAYERS ?=
+# QUEUE=1 runs the LAYERS back to back as one descriptor queue in a single design run
+QUEUE ?= 0
+CONV_TB_ARGS = $(if $(filter 1,$(QUEUE)),--queue) $(LAYERS)
+# the buffer writers and readers hold a whole chanStruct tile as a local, which is several MB
+# for wide arrays (e.g. ARRAY_IC0=8 ARRAY_OC0=64), so the C-sims run with an unlimited stack
+RUN_TB = ulimit -s unlimited;
 
 run_weight_tb: weight_tb
-	./weight_tb
+	$(RUN_TB) ./weight_tb
 
 weight_tb: ../src/WeightDoubleBufferTb.cpp 
 	$(CC) $(CFLAGS) -I$(MGC_HOME)/shared/include -I../src ../src/WeightDoubleBufferTb.cpp -o $@
 
 run_input_tb: input_tb
-	./input_tb
+	$(RUN_TB) ./input_tb
 
 input_tb: ../src/InputDoubleBufferTb.cpp 
 	$(CC) $(CFLAGS) -I$(MGC_HOME)/shared/include -I../src ../src/InputDoubleBufferTb.cpp -o $@
 
 run_conv_tb: conv_tb
-	./conv_tb
+	$(RUN_TB) ./conv_tb $(CONV_TB_ARGS)
 
-conv_tb: ../src/Conv.cpp ../src/ConvTb.cpp 
-	$(CC) $(CFLAGS) -I$(MGC_HOME)/shared/include -I../src ../src/Conv.cpp ../src/ConvTb.cpp -o $@
+conv_tb: ../src/Conv.cpp ../src/ConvTb.cpp ../src/conv_gold_fast.cpp ../src/conv_tb_params.h
+	$(CC) $(CFLAGS) $(TB_CFLAGS) -I$(MGC_HOME)/shared/include -I../src ../src/Conv.cpp ../src/ConvTb.cpp -o $@
+
+run_conv_tb_functional: conv_tb_functional
+	$(RUN_TB) ./conv_tb_functional $(CONV_TB_ARGS)
+
+# Same testbench with the bit-exact GEMM model in place of the cycle-stepped systolic array
+conv_tb_functional: ../src/Conv.cpp ../src/ConvTb.cpp ../src/conv_gold_fast.cpp ../src/conv_tb_params.h ../src/SystolicArrayFunctional.h
+	$(CC) $(CFLAGS) $(TB_CFLAGS) -DSYSTOLIC_ARRAY_FUNCTIONAL=1 -I$(MGC_HOME)/shared/include -I../src ../src/Conv.cpp ../src/ConvTb.cpp -o $@
 
 .PHONY: clean
 clean:
 	rm -f weight_tb
 	rm -f input_tb
 	rm -f conv_tb
+	rm -f conv_tb_functional
@@ -11,28 +11,31 @@ go compile
 source scripts/set_libraries.tcl
 
 
-solution library add "\[Block\] InputDoubleBuffer<4096,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>.v1"
-solution library add "\[Block\] WeightDoubleBuffer<8192,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>.v1"
-solution library add "\[Block\] SystolicArrayCore<IDTYPE,WDTYPE,ODTYPE,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>.v1"
+solution library add "\[Block\] InputDoubleBuffer<4096,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>.v1"
+solution library add "\[Block\] WeightDoubleBuffer<8192,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>.v1"
+solution library add "\[Block\] SystolicArrayCore<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE,${ARRAY_OC0},${ARRAY_IC0},${ACCUMULATION_BUFFER_SIZE}>.v1"
 
 go libraries
 directive set -CLOCKS $clocks 
 
-directive set /Conv/SystolicArrayCore<IDTYPE,WDTYPE,ODTYPE,${ARRAY_DIMENSION},${ARRAY_DIMENSION}> -MAP_TO_MODULE "\[Block\] SystolicArrayCore<IDTYPE,WDTYPE,ODTYPE,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>.v1"
-directive set /Conv/InputDoubleBuffer<4096,${ARRAY_DIMENSION},${ARRAY_DIMENSION}> -MAP_TO_MODULE "\[Block\] InputDoubleBuffer<4096,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>.v1"
-directive set /Conv/WeightDoubleBuffer<8192,${ARRAY_DIMENSION},${ARRAY_DIMENSION}> -MAP_TO_MODULE "\[Block\] WeightDoubleBuffer<8192,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>.v1"
+directive set /Conv/SystolicArrayCore<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE,${ARRAY_OC0},${ARRAY_IC0},${ACCUMULATION_BUFFER_SIZE}> -MAP_TO_MODULE "\[Block\] SystolicArrayCore<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE,${ARRAY_OC0},${ARRAY_IC0},${ACCUMULATION_BUFFER_SIZE}>.v1"
+directive set /Conv/InputDoubleBuffer<4096,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}> -MAP_TO_MODULE "\[Block\] InputDoubleBuffer<4096,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>.v1"
+directive set /Conv/WeightDoubleBuffer<8192,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}> -MAP_TO_MODULE "\[Block\] WeightDoubleBuffer<8192,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>.v1"
 
 directive set /Conv -FIFO_DEPTH 3
 directive set /Conv/systolicArray -FIFO_DEPTH 3
 
 
-directive set /Conv/outputSerializer/buffer:rsc -INTERLEAVE ${ARRAY_DIMENSION}
-# directive set /Conv/outputSerializer/buffer:rsc -BLOCK_SIZE 256
+# output tiles are ping-ponged so the drain of one tile overlaps the next
+directive set /Conv/outputSerializer/mem:cns -STAGE_REPLICATION 2
+directive set /Conv/outputSerializer/mem -WORD_WIDTH [expr ${ARRAY_OC0} * 32]
+# ACCUMULATION_BUFFER_SIZE rows per stage, in banks like the accumulation buffer
+directive set /Conv/outputSerializer/mem -BLOCK_SIZE ${ACCUMULATION_BANK_SIZE}
 
 
 go assembly
 
-directive set /Conv/SystolicArrayCore<IDTYPE,WDTYPE,ODTYPE,${ARRAY_DIMENSION},${ARRAY_DIMENSION}> -FIFO_DEPTH 3
+directive set /Conv/SystolicArrayCore<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE,${ARRAY_OC0},${ARRAY_IC0},${ACCUMULATION_BUFFER_SIZE}> -FIFO_DEPTH 3
 
 go architect
 
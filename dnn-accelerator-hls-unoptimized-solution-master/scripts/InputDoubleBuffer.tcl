@@ -3,7 +3,7 @@ set blockname [file rootname [file tail [info script] ]]
 source scripts/common.tcl
 
 directive set -DESIGN_HIERARCHY " 
-    {InputDoubleBuffer<4096, ${ARRAY_DIMENSION}, ${ARRAY_DIMENSION}>} 
+    {InputDoubleBuffer<4096, ${ARRAY_IC0}, ${ARRAY_OC0}, ${SERIAL_LANES}, ${ARRAY_CORES}>} 
 "
 
 go compile
@@ -20,11 +20,13 @@ go assembly
 # Your code starts here
 # -------------------------------
 #return -code error "Remove this once implemented."
-directive set /InputDoubleBuffer<4096,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/InputDoubleBufferReader<4096,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/din -WORD_WIDTH [expr ${ARRAY_DIMENSION} * 8]
-directive set /InputDoubleBuffer<4096,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/InputDoubleBufferWriter<4096,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/dout -WORD_WIDTH [expr ${ARRAY_DIMENSION} * 8]
-directive set /InputDoubleBuffer<4096,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/mem:cns -STAGE_REPLICATION 2
-directive set /InputDoubleBuffer<4096,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/mem -WORD_WIDTH [expr ${ARRAY_DIMENSION} * 8]
-directive set /InputDoubleBuffer<4096,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/.../tmp.data.value -match glob -WORD_WIDTH [expr ${ARRAY_DIMENSION} * 8]
+directive set /InputDoubleBuffer<4096,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>/InputDoubleBufferReader<4096,${ARRAY_IC0},${ARRAY_OC0},${ARRAY_CORES}>/din -WORD_WIDTH [expr ${ARRAY_IC0} * 8]
+directive set /InputDoubleBuffer<4096,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>/InputDoubleBufferWriter<4096,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>/dout -WORD_WIDTH [expr ${ARRAY_IC0} * 8]
+directive set /InputDoubleBuffer<4096,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>/InputDoubleBufferWriter<4096,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>/din -WORD_WIDTH [expr ${SERIAL_LANES} * 8]
+directive set /InputDoubleBuffer<4096,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>/mem:cns -STAGE_REPLICATION 2
+directive set /InputDoubleBuffer<4096,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>/mem -WORD_WIDTH [expr ${ARRAY_IC0} * 8]
+directive set /InputDoubleBuffer<4096,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>/.../tmp.data.value -match glob -WORD_WIDTH [expr ${ARRAY_IC0} * 8]
+directive set /InputDoubleBuffer<4096,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>/.../haloMem.value -match glob -WORD_WIDTH [expr ${ARRAY_IC0} * 8]
 # -------------------------------
 # Your code ends here
 # -------------------------------
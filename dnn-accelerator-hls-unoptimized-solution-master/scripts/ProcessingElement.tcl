@@ -3,7 +3,7 @@ set blockname [file rootname [file tail [info script] ]]
 source scripts/common.tcl
 
 directive set -DESIGN_HIERARCHY { 
-    {ProcessingElement<IDTYPE, WDTYPE, ODTYPE>} 
+    {ProcessingElement<ARRAY_IDTYPE, ARRAY_WDTYPE, ODTYPE>} 
 }
 
 go compile
@@ -16,7 +16,7 @@ directive set -CLOCKS $clocks
 
 go assembly
 
-directive set /ProcessingElement<IDTYPE,WDTYPE,ODTYPE>/run -DESIGN_GOAL Latency
-directive set /ProcessingElement<IDTYPE,WDTYPE,ODTYPE>/run -CLOCK_OVERHEAD 0.000000
+directive set /ProcessingElement<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE>/run -DESIGN_GOAL Latency
+directive set /ProcessingElement<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE>/run -CLOCK_OVERHEAD 0.000000
 
 go extract
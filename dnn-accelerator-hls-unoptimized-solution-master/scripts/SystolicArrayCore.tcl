@@ -3,30 +3,30 @@ set blockname [file rootname [file tail [info script] ]]
 source scripts/common.tcl
 
 directive set -DESIGN_HIERARCHY "
-    {SystolicArrayCore<IDTYPE, WDTYPE, ODTYPE, ${ARRAY_DIMENSION}, ${ARRAY_DIMENSION}>}
+    {SystolicArrayCore<ARRAY_IDTYPE, ARRAY_WDTYPE, ODTYPE, ${ARRAY_OC0}, ${ARRAY_IC0}, ${ACCUMULATION_BUFFER_SIZE}>}
 "
 
 go compile
 
 source scripts/set_libraries.tcl
 
-solution library add {[CCORE] ProcessingElement<IDTYPE,WDTYPE,ODTYPE>.v1}
+solution library add {[CCORE] ProcessingElement<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE>.v1}
 
 go libraries
 directive set -CLOCKS $clocks
-directive set /SystolicArrayCore<IDTYPE,WDTYPE,ODTYPE,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/ProcessingElement<IDTYPE,WDTYPE,ODTYPE> -MAP_TO_MODULE {[CCORE] ProcessingElement<IDTYPE,WDTYPE,ODTYPE>.v1}
+directive set /SystolicArrayCore<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE,${ARRAY_OC0},${ARRAY_IC0},${ACCUMULATION_BUFFER_SIZE}>/ProcessingElement<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE> -MAP_TO_MODULE {[CCORE] ProcessingElement<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE>.v1}
 
 go assembly
 
-directive set /SystolicArrayCore<IDTYPE,WDTYPE,ODTYPE,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/run -DESIGN_GOAL Latency
-directive set /SystolicArrayCore<IDTYPE,WDTYPE,ODTYPE,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/run -CLOCK_OVERHEAD 0.000000
+directive set /SystolicArrayCore<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE,${ARRAY_OC0},${ARRAY_IC0},${ACCUMULATION_BUFFER_SIZE}>/run -DESIGN_GOAL Latency
+directive set /SystolicArrayCore<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE,${ARRAY_OC0},${ARRAY_IC0},${ACCUMULATION_BUFFER_SIZE}>/run -CLOCK_OVERHEAD 0.000000
 
 # -------------------------------
 # Make sure that the accumulation buffer has the appropriate interleaving and block size
 # Your code starts here
 # -------------------------------
-directive set /SystolicArrayCore<IDTYPE,WDTYPE,ODTYPE,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/run/accumulation_buffer:rsc -INTERLEAVE ${ARRAY_DIMENSION}
-# directive set /SystolicArrayCore<IDTYPE,WDTYPE,ODTYPE,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/run/accumulation_buffer:rsc -BLOCK_SIZE 256
+directive set /SystolicArrayCore<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE,${ARRAY_OC0},${ARRAY_IC0},${ACCUMULATION_BUFFER_SIZE}>/run/accumulation_buffer:rsc -INTERLEAVE ${ARRAY_OC0}
+directive set /SystolicArrayCore<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE,${ARRAY_OC0},${ARRAY_IC0},${ACCUMULATION_BUFFER_SIZE}>/run/accumulation_buffer:rsc -BLOCK_SIZE ${ACCUMULATION_BANK_SIZE}
 
 # -------------------------------
 # Your code ends here
@@ -37,12 +37,14 @@ directive set /SystolicArrayCore<IDTYPE,WDTYPE,ODTYPE,${ARRAY_DIMENSION},${ARRAY
 # Map the input register, partial sum register, and weight register to registers and not memories, additionally set register threshold to 4096 (prevents unecessary registers in design) 
 # Your code starts here
 # -------------------------------
-directive set /SystolicArrayCore<IDTYPE,WDTYPE,ODTYPE,${ARRAY_DIMENSION},${ARRAY_DIMENSION}> -REGISTER_THRESHOLD 4096
-directive set /SystolicArrayCore<IDTYPE,WDTYPE,ODTYPE,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/run/input_reg:rsc -MAP_TO_MODULE {[Register]}
-directive set /SystolicArrayCore<IDTYPE,WDTYPE,ODTYPE,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/run/psum_reg:rsc -MAP_TO_MODULE {[Register]}
-directive set /SystolicArrayCore<IDTYPE,WDTYPE,ODTYPE,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/run/weight_reg:rsc -MAP_TO_MODULE {[Register]}
-directive set /SystolicArrayCore<IDTYPE,WDTYPE,ODTYPE,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/run/input_reg2:rsc -MAP_TO_MODULE {[Register]}
-directive set /SystolicArrayCore<IDTYPE,WDTYPE,ODTYPE,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/run/psum_reg2:rsc -MAP_TO_MODULE {[Register]}
+directive set /SystolicArrayCore<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE,${ARRAY_OC0},${ARRAY_IC0},${ACCUMULATION_BUFFER_SIZE}> -REGISTER_THRESHOLD 4096
+directive set /SystolicArrayCore<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE,${ARRAY_OC0},${ARRAY_IC0},${ACCUMULATION_BUFFER_SIZE}>/run/input_reg:rsc -MAP_TO_MODULE {[Register]}
+directive set /SystolicArrayCore<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE,${ARRAY_OC0},${ARRAY_IC0},${ACCUMULATION_BUFFER_SIZE}>/run/psum_reg:rsc -MAP_TO_MODULE {[Register]}
+directive set /SystolicArrayCore<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE,${ARRAY_OC0},${ARRAY_IC0},${ACCUMULATION_BUFFER_SIZE}>/run/weight_reg:rsc -MAP_TO_MODULE {[Register]}
+directive set /SystolicArrayCore<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE,${ARRAY_OC0},${ARRAY_IC0},${ACCUMULATION_BUFFER_SIZE}>/run/input_reg2:rsc -MAP_TO_MODULE {[Register]}
+directive set /SystolicArrayCore<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE,${ARRAY_OC0},${ARRAY_IC0},${ACCUMULATION_BUFFER_SIZE}>/run/psum_reg2:rsc -MAP_TO_MODULE {[Register]}
+directive set /SystolicArrayCore<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE,${ARRAY_OC0},${ARRAY_IC0},${ACCUMULATION_BUFFER_SIZE}>/run/bank_reg:rsc -MAP_TO_MODULE {[Register]}
+directive set /SystolicArrayCore<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE,${ARRAY_OC0},${ARRAY_IC0},${ACCUMULATION_BUFFER_SIZE}>/run/bank_skew:rsc -MAP_TO_MODULE {[Register]}
 # -------------------------------
 # Your code ends here
 # -------------------------------
@@ -3,7 +3,7 @@ set blockname [file rootname [file tail [info script] ]]
 source scripts/common.tcl
 
 directive set -DESIGN_HIERARCHY "
-    {WeightDoubleBuffer<8192, ${ARRAY_DIMENSION}, ${ARRAY_DIMENSION}>} 
+    {WeightDoubleBuffer<8192, ${ARRAY_IC0}, ${ARRAY_OC0}, ${SERIAL_LANES}, ${ARRAY_CORES}>} 
 "
 
 go compile
@@ -19,11 +19,12 @@ go assembly
 # Set the correct word widths and the stage replication
 # Your code starts here
 # -------------------------------
-directive set /WeightDoubleBuffer<8192,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/WeightDoubleBufferReader<8192,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/din -WORD_WIDTH [expr ${ARRAY_DIMENSION} * 8]
-directive set /WeightDoubleBuffer<8192,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/WeightDoubleBufferWriter<8192,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/dout -WORD_WIDTH [expr ${ARRAY_DIMENSION} * 8]
-directive set /WeightDoubleBuffer<8192,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/mem:cns -STAGE_REPLICATION 2
-directive set /WeightDoubleBuffer<8192,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/mem -WORD_WIDTH [expr ${ARRAY_DIMENSION} * 8]
-directive set /WeightDoubleBuffer<8192,${ARRAY_DIMENSION},${ARRAY_DIMENSION}>/.../tmp.data.value -match glob -WORD_WIDTH [expr ${ARRAY_DIMENSION} * 8]
+directive set /WeightDoubleBuffer<8192,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>/WeightDoubleBufferReader<8192,${ARRAY_IC0},${ARRAY_OC0}>/din -WORD_WIDTH [expr ${ARRAY_OC0} * ${ARRAY_WEIGHT_PRECISION}]
+directive set /WeightDoubleBuffer<8192,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>/WeightDoubleBufferWriter<8192,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>/dout -WORD_WIDTH [expr ${ARRAY_OC0} * ${ARRAY_WEIGHT_PRECISION}]
+directive set /WeightDoubleBuffer<8192,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>/WeightDoubleBufferWriter<8192,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>/din -WORD_WIDTH [expr ${SERIAL_LANES} * 8]
+directive set /WeightDoubleBuffer<8192,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>/mem:cns -STAGE_REPLICATION 2
+directive set /WeightDoubleBuffer<8192,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>/mem -WORD_WIDTH [expr ${ARRAY_OC0} * ${ARRAY_WEIGHT_PRECISION}]
+directive set /WeightDoubleBuffer<8192,${ARRAY_IC0},${ARRAY_OC0},${SERIAL_LANES},${ARRAY_CORES}>/.../tmp.data.value -match glob -WORD_WIDTH [expr ${ARRAY_OC0} * ${ARRAY_WEIGHT_PRECISION}]
 # -------------------------------
 # Your code ends here
 # -------------------------------
@@ -29,6 +29,30 @@ catch {
 }
 
 set ARRAY_DIMENSION 16
+# rows and columns of the systolic array, must match ARRAY_IC0 and ARRAY_OC0 in conv.h
+set ARRAY_IC0 $ARRAY_DIMENSION
+set ARRAY_OC0 $ARRAY_DIMENSION
+# values per input_serial / weight_serial packet, must match SERIAL_LANES in conv.h
+set SERIAL_LANES 4
+# systolic array cores, must match ARRAY_CORES in conv.h
+set ARRAY_CORES 1
+# array built for 2:4 sparse layers, must match SPARSE_ARRAY in conv.h
+set SPARSE_ARRAY 0
+# array built for Winograd layers, must match WINOGRAD in conv.h
+set WINOGRAD 0
+# bits of the array inputs and weights, ARRAY_INPUT_PRECISION and ARRAY_WEIGHT_PRECISION
+# in conv.h: the layer data widened by 2 and 4 bits with WINOGRAD
+if {$WINOGRAD} {
+    set ARRAY_INPUT_PRECISION 10
+    set ARRAY_WEIGHT_PRECISION 12
+} else {
+    set ARRAY_INPUT_PRECISION 8
+    set ARRAY_WEIGHT_PRECISION 8
+}
+# accumulation buffer rows per core, must match ACCUMULATION_BUFFER_SIZE in conv.h,
+# stored in banks of ACCUMULATION_BANK_SIZE rows
+set ACCUMULATION_BUFFER_SIZE 1024
+set ACCUMULATION_BANK_SIZE 256
 set clk_period 5.0
 set clocks "clk \"-CLOCK_PERIOD $clk_period -CLOCK_EDGE rising -CLOCK_HIGH_TIME [expr $clk_period/2] -CLOCK_OFFSET 0.000000 -CLOCK_UNCERTAINTY 0.0 -RESET_KIND async -RESET_SYNC_NAME rst -RESET_SYNC_ACTIVE high -RESET_ASYNC_NAME arst_n -RESET_ASYNC_ACTIVE low -ENABLE_NAME {} -ENABLE_ACTIVE high\" "
 
@@ -11,8 +11,10 @@
 #include "conv.h"
 #include <mc_scverify.h>
 
+#include "Pooler.h"
 #include "Serializer.h"
 #include "Deserializer.h"
+#include "PostProcessor.h"
 
 #include "InputDoubleBuffer.h"
 #include "WeightDoubleBuffer.h"
@@ -25,37 +27,59 @@ public:
     Conv(){}
 
 #pragma hls_design interface
-    void CCS_BLOCK(run)(ac_channel<PackedInt<INPUT_PRECISION, 4> > &input_serial, 
-                        ac_channel<PackedInt<WEIGHT_PRECISION, 4> > &weight_serial, 
-                        ac_channel<ODTYPE> &output_serial,
+    void CCS_BLOCK(run)(ac_channel<PackedInt<INPUT_PRECISION, SERIAL_LANES> > &input_serial, 
+                        ac_channel<PackedInt<WEIGHT_PRECISION, SERIAL_LANES> > &weight_serial, 
+                        ac_channel<PackedInt<INPUT_PRECISION, SERIAL_LANES> > &residual_serial,
+                        ac_channel<PackedInt<OUTPUT_PRECISION, OUTPUT_LANES> > &output_serial,
+                        ac_channel<uint_32> &skipped_macs,
+                        ac_channel<uint_16> &status,
                         ac_channel<uint_16> &paramsIn)
     {
-        paramsDeserializer.run(paramsIn, inputDoubleBufferParams, weightDoubleBufferParams, systolicArrayParams, outputSerializerParams);
+        paramsDeserializer.run(paramsIn, inputDoubleBufferParams, weightDoubleBufferParams, systolicArrayParams, outputSerializerParams, postProcessorParams, poolerParams, outputTransformParams, postProcessorTable, status);
 
-        inputDoubleBuffer.run(input_serial, input_out, inputDoubleBufferParams);
-        weightDoubleBuffer.run(weight_serial, weight_out, weightDoubleBufferParams);
-        systolicArray.run(input_out, weight_out, output, systolicArrayParams);
+        inputDoubleBuffer.run(input_serial, input_out, input_hi_out, inputDoubleBufferParams);
+        weightDoubleBuffer.run(weight_serial, weight_out, weight_index_out, weightDoubleBufferParams);
+        systolicArray.run(input_out, input_hi_out, weight_out, weight_index_out, output, skipped_macs, systolicArrayParams);
+        outputTransform.run(output, transformed, outputTransformParams);
 
-        outputSerializer.run(output, output_serial, outputSerializerParams);   
+        postProcessor.run(transformed, residual_serial, post_processed, postProcessorParams, postProcessorTable);
+        pooler.run(post_processed, pooled, poolerParams);
+        outputSerializer.run(pooled, output_serial, outputSerializerParams);   
     }
 
 private:
     ParamsDeserializer paramsDeserializer;
-    Serializer<PackedInt<OUTPUT_PRECISION, ARRAY_DIMENSION>, ODTYPE, ARRAY_DIMENSION, ACCUMULATION_BUFFER_SIZE> outputSerializer;
+    Serializer<PackedInt<OUTPUT_PRECISION, ARRAY_OC0>, ARRAY_OC0, ACCUMULATION_BUFFER_SIZE, OUTPUT_LANES> outputSerializer;
     ac_channel<Params> outputSerializerParams;
 
-    InputDoubleBuffer<INPUT_BUFFER_SIZE, ARRAY_DIMENSION, ARRAY_DIMENSION> inputDoubleBuffer;
+    InputDoubleBuffer<INPUT_BUFFER_SIZE, ARRAY_IC0, ARRAY_OC0, SERIAL_LANES, ARRAY_CORES> inputDoubleBuffer;
     ac_channel<Params> inputDoubleBufferParams;
 
-    WeightDoubleBuffer<WEIGHT_BUFFER_SIZE, ARRAY_DIMENSION, ARRAY_DIMENSION> weightDoubleBuffer;
+    WeightDoubleBuffer<WEIGHT_BUFFER_SIZE, ARRAY_IC0, ARRAY_OC0, SERIAL_LANES, ARRAY_CORES> weightDoubleBuffer;
     ac_channel<Params> weightDoubleBufferParams;
     
-    ac_channel<PackedInt<INPUT_PRECISION,ARRAY_DIMENSION> > input_out;
-    ac_channel<PackedInt<WEIGHT_PRECISION,ARRAY_DIMENSION> > weight_out;
-    ac_channel<PackedInt<OUTPUT_PRECISION,ARRAY_DIMENSION> > output;    
+    // one of each per systolic array core
+    ac_channel<PackedInt<INPUT_PRECISION,ARRAY_IC0> > input_out[ARRAY_CORES];
+    ac_channel<PackedInt<INPUT_PRECISION,ARRAY_IC0> > input_hi_out[ARRAY_CORES];  // sparse layers only
+    ac_channel<PackedInt<ARRAY_WEIGHT_PRECISION,ARRAY_OC0> > weight_out[ARRAY_CORES];
+    ac_channel<PackedInt<SPARSE_INDEX_PRECISION,ARRAY_OC0> > weight_index_out[ARRAY_CORES];  // sparse layers only
+    ac_channel<PackedInt<OUTPUT_PRECISION,ARRAY_OC0> > output;    
 
-    SystolicArrayWrapper<IDTYPE,WDTYPE,ODTYPE, ARRAY_DIMENSION, ARRAY_DIMENSION> systolicArray;
+    SystolicArrayCluster<ARRAY_IDTYPE,ARRAY_WDTYPE,ODTYPE, ARRAY_OC0, ARRAY_IC0, ARRAY_CORES, ACCUMULATION_BUFFER_SIZE> systolicArray;
     ac_channel<Params> systolicArrayParams;
+
+    WinogradOutputTransform<ARRAY_OC0, ACCUMULATION_BUFFER_SIZE / WINOGRAD_POSITIONS> outputTransform;
+    ac_channel<Params> outputTransformParams;
+    ac_channel<PackedInt<OUTPUT_PRECISION,ARRAY_OC0> > transformed;
+
+    PostProcessor<ARRAY_OC0, OC1_TABLE_SIZE, SERIAL_LANES> postProcessor;
+    ac_channel<Params> postProcessorParams;
+    ac_channel<PostProcessRow<ARRAY_OC0> > postProcessorTable;
+    ac_channel<PackedInt<OUTPUT_PRECISION,ARRAY_OC0> > post_processed;
+
+    Pooler<ARRAY_OC0, POOL_BUFFER_SIZE, POOL_ROWS> pooler;
+    ac_channel<Params> poolerParams;
+    ac_channel<PackedInt<OUTPUT_PRECISION,ARRAY_OC0> > pooled;
 };
 
 #endif
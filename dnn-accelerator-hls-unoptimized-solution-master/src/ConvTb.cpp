@@ -1,63 +1,501 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
 #include "conv.h"
 #include "conv_gold_tiled.cpp"
 #include "conv_gold.cpp"
+#include "conv_gold_fast.cpp"
 #include "Conv.cpp"
 #include "conv_tb_params.h"
 
-template <int OFMAP_HEIGHT, 
-          int OFMAP_WIDTH, 
-          int OFMAP_CHANNELS, 
-          int IFMAP_CHANNELS, 
-          int FILTER_SIZE, 
-          int STRIDE,
-          int IC0,
-          int OC0>
-int run_layer(Params params){
-    static IDTYPE input[(OFMAP_HEIGHT-1)*STRIDE+FILTER_SIZE][(OFMAP_WIDTH-1)*STRIDE+FILTER_SIZE][IFMAP_CHANNELS]; 
-    static WDTYPE weight[FILTER_SIZE][FILTER_SIZE][IFMAP_CHANNELS][OFMAP_CHANNELS]; 
-    static ODTYPE output_ref[OFMAP_HEIGHT][OFMAP_WIDTH][OFMAP_CHANNELS];
-    static ODTYPE output_ref_tiled[OFMAP_HEIGHT][OFMAP_WIDTH][OFMAP_CHANNELS];
-
-    static ac_channel<PackedInt<INPUT_PRECISION, 4> > input_stream;
-    static ac_channel<PackedInt<WEIGHT_PRECISION, 4> > weight_stream;
-    static ac_channel<ODTYPE> output_stream;
-    
-    int errCnt = 0;
+// Set to 1 to also run the naive conv_gold and conv_gold_tiled models and check
+// conv_gold_fast against them
+#ifndef CONV_GOLD_CROSS_CHECK
+#define CONV_GOLD_CROSS_CHECK 0
+#endif
+
+// Reads a flat layer specification such as layers/small_layer1.json
+// ({"OY1": 2, "OY0": 14, ...}) into key/value pairs
+bool read_layer_json(const char *filename, std::map<std::string, int> &fields){
+    std::ifstream file(filename);
+    if (!file) {
+      return false;
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    std::string text = contents.str();
+
+    size_t pos = 0;
+    while ((pos = text.find('"', pos)) != std::string::npos) {
+      size_t key_end = text.find('"', pos + 1);
+      size_t colon = text.find(':', key_end);
+      if (key_end == std::string::npos || colon == std::string::npos) {
+        return false;
+      }
+      fields[text.substr(pos + 1, key_end - pos - 1)] = atoi(text.c_str() + colon + 1);
+      pos = text.find_first_of(",}", colon);
+      if (pos == std::string::npos) {
+        break;
+      }
+    }
+    return true;
+}
+
+// Fills params from a layer specification, the optional fields default to the
+// values used by the original layers
+bool read_layer_params(const char *filename, Params &params, int &ic0, int &oc0){
+    std::map<std::string, int> fields;
+    if (!read_layer_json(filename, fields)) {
+      printf("Could not read layer file %s\n", filename);
+      return false;
+    }
+    const char *required[] = {"OY1", "OX1", "OY0", "OX0", "OC1", "IC1", "FX", "FY", "STRIDE", "IC0", "OC0"};
+    for (unsigned k = 0; k < sizeof(required) / sizeof(required[0]); k++) {
+      if (fields.find(required[k]) == fields.end()) {
+        printf("Layer file %s is missing %s\n", filename, required[k]);
+        return false;
+      }
+    }
+    params.OY1 = fields["OY1"];
+    params.OX1 = fields["OX1"];
+    params.OY0 = fields["OY0"];
+    params.OX0 = fields["OX0"];
+    params.OC1 = fields["OC1"];
+    params.IC1 = fields["IC1"];
+    params.FX = fields["FX"];
+    params.FY = fields["FY"];
+    params.STRIDE = fields["STRIDE"];
+    params.LOOP_ORDER = fields.count("LOOP_ORDER") ? fields["LOOP_ORDER"] : LOOP_ORDER_SPATIAL_OUTER;
+    params.RELU = fields.count("RELU") ? fields["RELU"] : 0;
+    params.REQUANTIZE = fields.count("REQUANTIZE") ? fields["REQUANTIZE"] : 0;
+    params.PAD_TOP = fields.count("PAD_TOP") ? fields["PAD_TOP"] : 0;
+    params.PAD_BOTTOM = fields.count("PAD_BOTTOM") ? fields["PAD_BOTTOM"] : 0;
+    params.PAD_LEFT = fields.count("PAD_LEFT") ? fields["PAD_LEFT"] : 0;
+    params.PAD_RIGHT = fields.count("PAD_RIGHT") ? fields["PAD_RIGHT"] : 0;
+    params.N = fields.count("N") ? fields["N"] : 1;
+    params.CONV_MODE = fields.count("CONV_MODE") ? fields["CONV_MODE"] : CONV_MODE_DENSE;
+    params.RESIDUAL = fields.count("RESIDUAL") ? fields["RESIDUAL"] : 0;
+    params.RESIDUAL_SHIFT = fields.count("RESIDUAL_SHIFT") ? fields["RESIDUAL_SHIFT"] : 0;
+    params.POOL = fields.count("POOL") ? fields["POOL"] : POOL_NONE;
+    params.POOL_SIZE = fields.count("POOL_SIZE") ? fields["POOL_SIZE"] : 1;
+    params.POOL_STRIDE = fields.count("POOL_STRIDE") ? fields["POOL_STRIDE"] : 1;
+    params.POOL_PAD = fields.count("POOL_PAD") ? fields["POOL_PAD"] : 0;
+    // the average over POOL_SIZE^2 positions unless the layer gives its own scale
+    params.POOL_SHIFT = fields.count("POOL_SHIFT") ? fields["POOL_SHIFT"] : 15;
+    params.PRECISION = fields.count("PRECISION") ? fields["PRECISION"] : PRECISION_INT8;
+    params.SPARSE = fields.count("SPARSE") ? fields["SPARSE"] : 0;
+    params.WEIGHT_COMPRESSION = fields.count("WEIGHT_COMPRESSION") ? fields["WEIGHT_COMPRESSION"] : WEIGHT_COMPRESSION_NONE;
+    int window = params.POOL_SIZE * params.POOL_SIZE;
+    int average_scale = ((1 << params.POOL_SHIFT) + window / 2) / window;
+    params.POOL_SCALE = fields.count("POOL_SCALE") ? fields["POOL_SCALE"] : average_scale;
+    ic0 = fields["IC0"];
+    oc0 = fields["OC0"];
+    return true;
+}
+
+// One layer of a testbench run: its descriptor, the generated tensors and the
+// reference output. Tensors are sized from params at runtime so that one binary
+// can sweep any number of layers.
+struct ConvLayer {
+    const char *name;
+    Params params;
+    int IC0;
+    int OC0;
+    // input[N][IFMAP_HEIGHT][IFMAP_WIDTH][IFMAP_CHANNELS], including the zero padding
+    std::vector<IDTYPE> input;
+    // the int4 values of an INT4 layer are kept one per element, packed when streamed
+    // weight[FILTER_SIZE][FILTER_SIZE][IFMAP_CHANNELS][OFMAP_CHANNELS], diagonal in
+    // IFMAP_CHANNELS/OFMAP_CHANNELS for a depthwise layer, 2 of every 4 consecutive
+    // IFMAP_CHANNELS nonzero for a sparse layer
+    std::vector<WDTYPE> weight;
+    // residual[N][OFMAP_HEIGHT][OFMAP_WIDTH][OFMAP_CHANNELS], only with params.RESIDUAL
+    std::vector<IDTYPE> residual;
+    // output_ref[N][OFMAP_HEIGHT][OFMAP_WIDTH][OFMAP_CHANNELS], the pooled height and
+    // width with params.POOL
+    std::vector<ODTYPE> output_ref;
+    // per output channel requantization constants, only with params.REQUANTIZE
+    std::vector<int32_t> bias;
+    std::vector<int32_t> scale;
+    std::vector<int32_t> shift;
+    // MACs the array skips for zero inputs, modulo 2^32 like the design's counter
+    uint32_t skipped_macs;
+    // status the design reports for the descriptor, see PARAMS_STATUS_OK
+    int status;
+};
+
+#define INPUT(n, y, x, c) input[(((size_t) (n) * IFMAP_HEIGHT + (y)) * IFMAP_WIDTH + (x)) * IFMAP_CHANNELS + (c)]
+#define WEIGHT(fy, fx, c, k) weight[(((size_t) (fy) * FILTER_SIZE + (fx)) * IFMAP_CHANNELS + (c)) * OFMAP_CHANNELS + (k)]
+#define OUTPUT_REF(ref, n, y, x, k) ref[(((size_t) (n) * OFMAP_HEIGHT + (y)) * OFMAP_WIDTH + (x)) * OFMAP_CHANNELS + (k)]
+
+// Writes values to input_serial or weight_serial, SERIAL_LANES values per packet
+template <int precision>
+struct SerialWriter {
+    ac_channel<PackedInt<precision, SERIAL_LANES> > &stream;
+    PackedInt<precision, SERIAL_LANES> packet;
+    int lane;
+
+    SerialWriter(ac_channel<PackedInt<precision, SERIAL_LANES> > &stream) : stream(stream), lane(0) {}
+
+    void write(ac_int<precision> value){
+      packet.value[lane++] = value;
+      if (lane == SERIAL_LANES) {
+        stream.write(packet);
+        lane = 0;
+      }
+    }
+
+    // the last packet of a tile is zero padded
+    void end_tile(){
+      if (lane != 0) {
+        for (; lane < SERIAL_LANES; lane++) {
+          packet.value[lane] = 0;
+        }
+        stream.write(packet);
+        lane = 0;
+      }
+    }
+};
+
+// Writes rows of OC0 weights to weight_serial in the format of
+// Params.WEIGHT_COMPRESSION, one value at a time
+struct WeightRowWriter {
+    SerialWriter<WEIGHT_PRECISION> writer;
+    bool zero_mask;
+    std::vector<WDTYPE> row;
+    int row_size;
+    size_t values;    // weights written
+    size_t streamed;  // values on weight_serial
+
+    WeightRowWriter(ac_channel<PackedInt<WEIGHT_PRECISION, SERIAL_LANES> > &stream, bool zero_mask, int row_size) :
+        writer(stream), zero_mask(zero_mask), row_size(row_size), values(0), streamed(0) {}
+
+    void write(WDTYPE value){
+      values++;
+      if (!zero_mask) {
+        stream(value);
+        return;
+      }
+      row.push_back(value);
+      if ((int) row.size() == row_size) {
+        // the mask bytes, then the nonzero values in column order
+        for (int b = 0; b < row_size / WEIGHT_PRECISION; b++) {
+          WDTYPE mask = 0;
+          for (int j = 0; j < WEIGHT_PRECISION; j++) {
+            mask.set_slc(j, (ac_int<1, false>) (row[b * WEIGHT_PRECISION + j] != 0));
+          }
+          stream(mask);
+        }
+        for (int j = 0; j < row_size; j++) {
+          if (row[j] != 0) {
+            stream(row[j]);
+          }
+        }
+        row.clear();
+      }
+    }
+
+    void end_tile(){
+      writer.end_tile();
+    }
+
+    void stream(WDTYPE value){
+      writer.write(value);
+      streamed++;
+    }
+};
+
+// Packs the int4 channels 2i and 2i+1 into one value, see Params.PRECISION
+IDTYPE pack_int4(IDTYPE lo, IDTYPE hi){
+    IDTYPE value;
+    value.set_slc(0, lo.slc<4>(0));
+    value.set_slc(4, hi.slc<4>(0));
+    return value;
+}
+
+// G' = 2G of Winograd F(2x2, 3x3), see CONV_MODE_WINOGRAD
+const int WINOGRAD_G[WINOGRAD_TILE][3] = {
+    {2,  0, 0},
+    {1,  1, 1},
+    {1, -1, 1},
+    {0,  0, 2}
+};
+
+// Transformed position pos of the 3x3 filter g, row major: (G' g G'^T)[pos]
+int winograd_weight(const int g[3][3], int pos){
+    int sum = 0;
+    for (int a = 0; a < 3; a++) {
+      for (int b = 0; b < 3; b++) {
+        sum += WINOGRAD_G[pos / WINOGRAD_TILE][a] * g[a][b] * WINOGRAD_G[pos % WINOGRAD_TILE][b];
+      }
+    }
+    return sum;
+}
+
+// Transformed position pos of the 4x4 input patch d, row major: (B^T d B)[pos]
+int winograd_input(const int d[WINOGRAD_TILE][WINOGRAD_TILE], int pos){
+    int sum = 0;
+    for (int a = 0; a < WINOGRAD_TILE; a++) {
+      for (int b = 0; b < WINOGRAD_TILE; b++) {
+        sum += winograd_bt(pos / WINOGRAD_TILE, a) * d[a][b] * winograd_bt(pos % WINOGRAD_TILE, b);
+      }
+    }
+    return sum;
+}
+
+// Whether a position of the padded input image is inside the unpadded image
+bool input_inside(const Params &params, int ifmap_height, int ifmap_width, int row, int col){
+    return row >= params.PAD_TOP && row < ifmap_height - params.PAD_BOTTOM &&
+           col >= params.PAD_LEFT && col < ifmap_width - params.PAD_RIGHT;
+}
+
+// Writes the PARAMS_WORDS words of a layer descriptor to Conv's paramsIn
+void write_descriptor(const Params &params, ac_channel<uint_16> &params_stream){
+    params_stream.write(params.OY1);
+    params_stream.write(params.OX1);
+    params_stream.write(params.OY0);
+    params_stream.write(params.OX0);
+    params_stream.write(params.OC1);
+    params_stream.write(params.IC1);
+    params_stream.write(params.FX);
+    params_stream.write(params.FY);
+    params_stream.write(params.STRIDE);
+    params_stream.write(params.LOOP_ORDER);
+    params_stream.write(params.RELU);
+    params_stream.write(params.REQUANTIZE);
+    params_stream.write(params.PAD_TOP);
+    params_stream.write(params.PAD_BOTTOM);
+    params_stream.write(params.PAD_LEFT);
+    params_stream.write(params.PAD_RIGHT);
+    params_stream.write(params.N);
+    params_stream.write(params.CONV_MODE);
+    params_stream.write(params.RESIDUAL);
+    params_stream.write(params.RESIDUAL_SHIFT);
+    params_stream.write(params.POOL);
+    params_stream.write(params.POOL_SIZE);
+    params_stream.write(params.POOL_STRIDE);
+    params_stream.write(params.POOL_PAD);
+    params_stream.write(params.POOL_SCALE);
+    params_stream.write(params.POOL_SHIFT);
+    params_stream.write(params.PRECISION);
+    params_stream.write(params.SPARSE);
+    params_stream.write(params.WEIGHT_COMPRESSION);
+}
+
+// Generates the layer tensors and reference output, and queues the layer's
+// inputs, weights and descriptor on the design interfaces
+int queue_layer(ConvLayer &layer,
+                ac_channel<PackedInt<INPUT_PRECISION, SERIAL_LANES> > &input_stream,
+                ac_channel<PackedInt<WEIGHT_PRECISION, SERIAL_LANES> > &weight_stream,
+                ac_channel<PackedInt<INPUT_PRECISION, SERIAL_LANES> > &residual_stream,
+                ac_channel<uint_16> &params_stream){
+    Params params = layer.params;
+    const int IC0 = layer.IC0;
+    const int OC0 = layer.OC0;
+    // the array dimensions still have to match the compiled design
+    if (IC0 != ARRAY_IC0 || OC0 != ARRAY_OC0) {
+      printf("Layer IC0 = %d, OC0 = %d does not match ARRAY_IC0 = %d, ARRAY_OC0 = %d\n", IC0, OC0, ARRAY_IC0, ARRAY_OC0);
+      return 1;
+    }
+    if (params.FX != params.FY) {
+      printf("Only square filters are supported, FX = %d, FY = %d\n", (int) params.FX, (int) params.FY);
+      return 1;
+    }
+    const bool depthwise = (params.CONV_MODE == CONV_MODE_DEPTHWISE);
+    if (depthwise && (IC0 != OC0 || params.IC1 != params.OC1 || params.FX > IC0)) {
+      printf("Depthwise layers need IC0 == OC0, IC1 == OC1 and FX <= IC0, IC1 = %d, OC1 = %d, FX = %d\n", (int) params.IC1, (int) params.OC1, (int) params.FX);
+      return 1;
+    }
+    const bool int4 = (params.PRECISION == PRECISION_INT4);
+    if (int4 && depthwise) {
+      printf("INT4 precision needs a DENSE or GEMM layer\n");
+      return 1;
+    }
+    const bool sparse = (params.SPARSE != 0);
+    if (sparse && (!SPARSE_ARRAY || depthwise || int4 || params.IC1 % 2 != 0 || IC0 % SPARSE_GROUP != 0)) {
+      printf("Sparse layers need a SPARSE_ARRAY build and a DENSE or GEMM layer in INT8 with an even IC1, IC1 = %d\n", (int) params.IC1);
+      return 1;
+    }
+    const bool winograd = (params.CONV_MODE == CONV_MODE_WINOGRAD);
+    if (winograd && (!WINOGRAD || params.FX != 3 || params.STRIDE != 1 || params.OY0 % 2 != 0 || params.OX0 % 2 != 0 || int4 || sparse)) {
+      printf("Winograd layers need a WINOGRAD build, FX == FY == 3, STRIDE == 1, even OY0 and OX0, INT8 and no SPARSE\n");
+      return 1;
+    }
+    if (params.WEIGHT_COMPRESSION > WEIGHT_COMPRESSION_ZERO_MASK || OC0 % WEIGHT_PRECISION != 0) {
+      printf("Unknown WEIGHT_COMPRESSION = %d\n", (int) params.WEIGHT_COMPRESSION);
+      return 1;
+    }
+    if (params.CONV_MODE == CONV_MODE_GEMM &&
+        (params.FX != 1 || params.FY != 1 || params.STRIDE != 1 ||
+         params.PAD_TOP != 0 || params.PAD_BOTTOM != 0 || params.PAD_LEFT != 0 || params.PAD_RIGHT != 0)) {
+      printf("GEMM layers need FX == FY == STRIDE == 1 and no padding\n");
+      return 1;
+    }
+    if (params.RESIDUAL_SHIFT >= OUTPUT_PRECISION) {
+      printf("RESIDUAL_SHIFT = %d exceeds the accumulator precision\n", (int) params.RESIDUAL_SHIFT);
+      return 1;
+    }
+    if (params.POOL != POOL_NONE) {
+      if (params.POOL_STRIDE == 0 || params.POOL_SIZE == 0 || params.POOL_SIZE > 2 * params.POOL_STRIDE ||
+          params.POOL_PAD >= params.POOL_STRIDE || params.POOL_SHIFT >= (1 << POOL_SHIFT_PRECISION)) {
+        printf("Pooling needs 0 < POOL_SIZE <= 2 * POOL_STRIDE and POOL_PAD < POOL_STRIDE\n");
+        return 1;
+      }
+      int pooled_height = pool_output_size(params.OY1 * params.OY0, params.POOL_SIZE.to_int(), params.POOL_STRIDE.to_int(), params.POOL_PAD.to_int());
+      int pooled_width = pool_output_size(params.OX1 * params.OX0, params.POOL_SIZE.to_int(), params.POOL_STRIDE.to_int(), params.POOL_PAD.to_int());
+      if (pooled_height <= 0 || pooled_width <= 0) {
+        printf("Pooling leaves no output\n");
+        return 1;
+      }
+    }
+    // the design rejects a layer that overflows a buffer or table, only its descriptor is
+    // queued and check_layer expects the status
+    layer.status = params_status(params).to_int();
+    if (layer.status != PARAMS_STATUS_OK) {
+      write_descriptor(params, params_stream);
+      return 0;
+    }
+
+    const int BATCH = params.N;
+    const int OFMAP_HEIGHT = params.OY0 * params.OY1;
+    const int OFMAP_WIDTH = params.OX0 * params.OX1;
+    const int OFMAP_CHANNELS = OC0 * params.OC1;
+    // input channels per channel tile, an INT4 lane carries two
+    const int IC0_CHANNELS = int4 ? 2 * IC0 : IC0;
+    const int IFMAP_CHANNELS = IC0_CHANNELS * params.IC1;
+    const int FILTER_SIZE = params.FX;
+    const int STRIDE = params.STRIDE;
+    const int IFMAP_HEIGHT = (OFMAP_HEIGHT-1)*STRIDE+FILTER_SIZE;
+    const int IFMAP_WIDTH = (OFMAP_WIDTH-1)*STRIDE+FILTER_SIZE;
+    if (params.PAD_TOP + params.PAD_BOTTOM >= IFMAP_HEIGHT || params.PAD_LEFT + params.PAD_RIGHT >= IFMAP_WIDTH) {
+      printf("Padding leaves no input image, IFMAP_HEIGHT = %d, IFMAP_WIDTH = %d\n", IFMAP_HEIGHT, IFMAP_WIDTH);
+      return 1;
+    }
+
+    std::vector<IDTYPE> &input = layer.input;
+    std::vector<WDTYPE> &weight = layer.weight;
+    std::vector<ODTYPE> &output_ref = layer.output_ref;
+    input.resize((size_t) BATCH * IFMAP_HEIGHT * IFMAP_WIDTH * IFMAP_CHANNELS);
+    weight.resize((size_t) FILTER_SIZE * FILTER_SIZE * IFMAP_CHANNELS * OFMAP_CHANNELS);
+    output_ref.resize((size_t) BATCH * OFMAP_HEIGHT * OFMAP_WIDTH * OFMAP_CHANNELS);
+#if CONV_GOLD_CROSS_CHECK
+    std::vector<ODTYPE> output_ref_naive(output_ref.size());
+    std::vector<ODTYPE> output_ref_tiled(output_ref.size());
+#endif
+
     int rand_init = 1;
 
     printf("Generating Input\n");
  
-    // initialize input image  
+    // initialize input images, the padding border stays zero so that the
+    // reference models see the padded image
+    for (int n = 0; n < BATCH; n++) {
     for (int row = 0; row < STRIDE * (OFMAP_HEIGHT-1) + FILTER_SIZE; row++) {
       for (int col = 0; col < STRIDE * (OFMAP_WIDTH-1) + FILTER_SIZE; col++) {
         for (int c = 0; c < IFMAP_CHANNELS; c++) {
-          if (rand_init == 1) {
-            input[row][col][c] = (IDTYPE)(rand() % 100); 
+          if (!input_inside(params, IFMAP_HEIGHT, IFMAP_WIDTH, row, col)) {
+            INPUT(n, row, col, c) = 0;
+          } else if (rand_init == 1) {
+            INPUT(n, row, col, c) = int4 ? (IDTYPE)(rand() % 16 - 8) : (IDTYPE)(rand() % 100); 
           } else {
-            input[row][col][c] = c + IFMAP_CHANNELS*col + IFMAP_CHANNELS*(OFMAP_WIDTH+FILTER_SIZE-1)*row;
+            INPUT(n, row, col, c) = c + IFMAP_CHANNELS*col + IFMAP_CHANNELS*(OFMAP_WIDTH+FILTER_SIZE-1)*row;
           }
         }
       }
     }
+    }  // for n
 
-    // streaming input to the interface
+    // streaming input to the interface, the padding is generated on chip
+    SerialWriter<INPUT_PRECISION> input_writer(input_stream);
+    // in weight stationary order the spatial tiles are streamed once per group of
+    // kernel tiles that run side by side on the ARRAY_CORES cores
+    int input_repeats = (params.LOOP_ORDER == LOOP_ORDER_WEIGHT_STATIONARY) ? kernel_tile_groups(params, ARRAY_CORES).to_int() : 1;
+    for (int rep = 0; rep < input_repeats; rep++) {
     for (int ro = 0; ro < params.OY1; ro++) {
       for (int co = 0; co < params.OX1; co++) {
+        // a tile holds the window of every image in the batch
         for (int c=0; c< params.IC1; c++) {
+        for (int n = 0; n < BATCH; n++) {
           for (int p = 0; p < STRIDE*(params.OY0-1) + FILTER_SIZE; p++ ){
             for (int j = 0; j < (STRIDE*(params.OX0-1) + FILTER_SIZE); j++ ){
-              for (int i = 0; i < IC0/4; i++ ){
-                PackedInt<INPUT_PRECISION, 4> input_tmp;
-                for(int ii = 0; ii < 4; ii++){
-                  input_tmp.value[ii] = input[ro*STRIDE*params.OY0+p][co*STRIDE*params.OX0+j][c*IC0+i*4+ii];
+              if (!input_inside(params, IFMAP_HEIGHT, IFMAP_WIDTH, ro*STRIDE*params.OY0+p, co*STRIDE*params.OX0+j)) {
+                continue;
+              }
+              // the halo columns shared with the previous tile are already on chip
+              if (co != 0 && j < FILTER_SIZE - STRIDE) {
+                continue;
+              }
+              for (int i = 0; i < IC0; i++ ){
+                int y = ro*STRIDE*params.OY0+p, x = co*STRIDE*params.OX0+j;
+                if (int4) {
+                  input_writer.write(pack_int4(INPUT(n, y, x, c*IC0_CHANNELS+2*i), INPUT(n, y, x, c*IC0_CHANNELS+2*i+1)));
+                } else {
+                  input_writer.write(INPUT(n, y, x, c*IC0+i));
                 }
-                input_stream.write(input_tmp);
               }  // for i
             }  // for j 
           }  // for p
+        }  // for n
         }  // for c
+        input_writer.end_tile();
       }  // for co
     }  // for ro
+    }  // for rep
+
+    // zero activation gating: every array row whose inputs of a pixel are all zero
+    // skips OC0 MACs, for every kernel tile. The rows see a lane (INT8, INT4) or
+    // group of 4 channels (SPARSE, 2 rows each) of the window's input positions,
+    // or with Winograd a transformed position of the 2x2 output patches.
+    layer.skipped_macs = 0;
+    if (winograd) {
+      uint32_t zero_rows = 0;
+      for (int n = 0; n < BATCH; n++) {
+        for (int py = 0; py < OFMAP_HEIGHT / 2; py++) {
+          for (int px = 0; px < OFMAP_WIDTH / 2; px++) {
+            for (int c = 0; c < IFMAP_CHANNELS; c++) {
+              int d[WINOGRAD_TILE][WINOGRAD_TILE];
+              for (int i = 0; i < WINOGRAD_TILE; i++) {
+                for (int j = 0; j < WINOGRAD_TILE; j++) {
+                  d[i][j] = INPUT(n, 2*py+i, 2*px+j, c).to_int();
+                }
+              }
+              for (int pos = 0; pos < WINOGRAD_POSITIONS; pos++) {
+                zero_rows += (winograd_input(d, pos) == 0) ? 1 : 0;
+              }
+            }
+          }
+        }
+      }
+      layer.skipped_macs = zero_rows * OC0 * params.OC1;
+    } else if (!depthwise) {
+      const int row_channels = sparse ? SPARSE_GROUP : IC0_CHANNELS / IC0;
+      const int row_count = sparse ? 2 : 1;
+      uint32_t zero_rows = 0;
+      for (int n = 0; n < BATCH; n++) {
+        for (int oy = 0; oy < OFMAP_HEIGHT; oy++) {
+          for (int ox = 0; ox < OFMAP_WIDTH; ox++) {
+            for (int wy = 0; wy < FILTER_SIZE; wy++) {
+              for (int wx = 0; wx < FILTER_SIZE; wx++) {
+                for (int c = 0; c < IFMAP_CHANNELS; c += row_channels) {
+                  bool zero = true;
+                  for (int g = 0; g < row_channels; g++) {
+                    zero = zero && INPUT(n, oy*STRIDE+wy, ox*STRIDE+wx, c+g) == 0;
+                  }
+                  zero_rows += zero ? row_count : 0;
+                }
+              }
+            }
+          }
+        }
+      }
+      layer.skipped_macs = zero_rows * OC0 * params.OC1;
+    }
  
 
     printf("Generating Weight\n");
@@ -67,227 +505,485 @@ int run_layer(Params params){
       for (int wx = 0; wx < FILTER_SIZE; wx++) {  
         for (int c = 0; c < IFMAP_CHANNELS; c++) {
           for (int k = 0; k < OFMAP_CHANNELS; k++) {
-            if (rand_init == 1) {
-              weight[wy][wx][c][k] = (IDTYPE)(rand()%100);  
+            if (depthwise && c != k) {
+              WEIGHT(wy, wx, c, k) = 0;
+            } else if (rand_init == 1) {
+              WEIGHT(wy, wx, c, k) = int4 ? (IDTYPE)(rand() % 16 - 8) : (IDTYPE)(rand()%100);  
             } else {
-              weight[wy][wx][c][k] = c + k + OFMAP_CHANNELS*c + OFMAP_CHANNELS*IFMAP_CHANNELS*wx + OFMAP_CHANNELS*IFMAP_CHANNELS*FILTER_SIZE*wy;  
+              WEIGHT(wy, wx, c, k) = c + k + OFMAP_CHANNELS*c + OFMAP_CHANNELS*IFMAP_CHANNELS*wx + OFMAP_CHANNELS*IFMAP_CHANNELS*FILTER_SIZE*wy;  
             }
           }
         }  
+        // 2:4 sparsity: keep 2 random channels of every group of 4
+        if (sparse) {
+          for (int c = 0; c < IFMAP_CHANNELS; c += SPARSE_GROUP) {
+            for (int k = 0; k < OFMAP_CHANNELS; k++) {
+              int a = rand() % SPARSE_GROUP;
+              int b = (a + 1 + rand() % (SPARSE_GROUP - 1)) % SPARSE_GROUP;
+              for (int g = 0; g < SPARSE_GROUP; g++) {
+                if (g != a && g != b) {
+                  WEIGHT(wy, wx, c + g, k) = 0;
+                }
+              }
+            }
+          }
+        }
       }
     }
     
     printf("Streaming Weight\n");
-    // streaming weight to the interface
-    for (int ro = 0; ro < params.OY1; ro++) {
-      for (int co = 0; co < params.OX1; co++) {     
+    // streaming weight to the interface, once per batch
+    WeightRowWriter weight_writer(weight_stream, params.WEIGHT_COMPRESSION == WEIGHT_COMPRESSION_ZERO_MASK, OC0);
+    // in weight stationary order every kernel tile is streamed only once
+    int weight_repeats = (params.LOOP_ORDER == LOOP_ORDER_WEIGHT_STATIONARY) ? 1 : (int)(params.OY1 * params.OX1);
+    for (int rep = 0; rep < weight_repeats; rep++) {
         for(int koo = 0; koo < params.OC1; koo++){
+          if (depthwise) {
+            // one weight per tap and channel
+            for (int wy = 0; wy <params.FY; wy++) {
+              for (int wx = 0; wx <params.FX; wx++) {
+                for ( int j = 0; j < OC0; j++ ){
+                  weight_writer.write(WEIGHT(wy, wx, koo*OC0 + j, koo*OC0 + j));
+                }  // for j
+              }  // for wx
+            }  // for wy
+            weight_writer.end_tile();
+            continue;
+          }
+          if (winograd) {
+            // the pre-transformed weights of every transformed position, each row as
+            // the low bytes of its OC0 weights followed by their high bytes
+            for (int c = 0; c < params.IC1; c++) {
+              for (int pos = 0; pos < WINOGRAD_POSITIONS; pos++) {
+                for (int i = 0; i < IC0; i++) {
+                  std::vector<int> row(OC0);
+                  for (int j = 0; j < OC0; j++) {
+                    int g[3][3];
+                    for (int wy = 0; wy < 3; wy++) {
+                      for (int wx = 0; wx < 3; wx++) {
+                        g[wy][wx] = WEIGHT(wy, wx, c*IC0+i, koo*OC0 + j).to_int();
+                      }
+                    }
+                    row[j] = winograd_weight(g, pos);
+                  }
+                  for (int j = 0; j < OC0; j++) {
+                    weight_writer.write((WDTYPE) (row[j] & 0xff));
+                  }
+                  for (int j = 0; j < OC0; j++) {
+                    weight_writer.write((WDTYPE) (row[j] >> 8));
+                  }
+                }  // for i
+              }  // for pos
+            }  // for c
+            weight_writer.end_tile();
+            continue;
+          }
+          if (sparse) {
+            // a window covers channel tiles 2c and 2c+1, slots 2g and 2g+1 hold the
+            // nonzero weights of channel group g, filled up with zero weights
+            for (int c = 0; c < params.IC1 / 2; c++) {
+              for (int wy = 0; wy <params.FY; wy++) {
+                for (int wx = 0; wx <params.FX; wx++) {
+                  for (int r = 0; r < IC0 / SPARSE_GROUP; r++) {
+                    int slot_index[SPARSE_GROUP][ARRAY_OC0];
+                    for ( int j = 0; j < OC0; j++ ){
+                      for (int s = 0; s < SPARSE_GROUP; s += 2) {
+                        int group = 2 * c * IC0 + SPARSE_GROUP * ((SPARSE_GROUP * r + s) / 2);
+                        int taken = 0;
+                        for (int g = 0; g < SPARSE_GROUP && taken < 2; g++) {
+                          if (WEIGHT(wy, wx, group + g, koo*OC0 + j) != 0) {
+                            slot_index[s + taken++][j] = g;
+                          }
+                        }
+                        for (int g = 0; taken < 2; g++) {
+                          if (taken == 0 || slot_index[s][j] != g) {
+                            slot_index[s + taken++][j] = g;
+                          }
+                        }
+                      }
+                      WDTYPE indices = 0;
+                      for (int s = 0; s < SPARSE_GROUP; s++) {
+                        indices.set_slc(SPARSE_INDEX_PRECISION * s, (ac_int<SPARSE_INDEX_PRECISION, false>) slot_index[s][j]);
+                      }
+                      weight_writer.write(indices);
+                    }  // for j
+                    for (int s = 0; s < SPARSE_GROUP; s++) {
+                      int group = 2 * c * IC0 + SPARSE_GROUP * ((SPARSE_GROUP * r + s) / 2);
+                      for ( int j = 0; j < OC0; j++ ){
+                        weight_writer.write(WEIGHT(wy, wx, group + slot_index[s][j], koo*OC0 + j));
+                      }  // for j
+                    }  // for s
+                  }  // for r
+                }  // for wx
+              }  // for wy
+            }  // for c
+            weight_writer.end_tile();
+            continue;
+          }
           for (int c = 0; c < params.IC1; c++) {
             for (int wy = 0; wy <params.FY; wy++) {
               for (int wx = 0; wx <params.FX; wx++) {
                 for ( int i = 0; i < IC0; i++ ){
-                    for ( int j = 0; j < OC0/4; j++ ){
-                      PackedInt<WEIGHT_PRECISION, 4> weight_tmp;
-                      for(int jj = 0; jj < 4; jj++){
-                        weight_tmp.value[jj] = weight[wy][wx][c*IC0+i][koo*OC0 + j*4+jj];
+                    for ( int j = 0; j < OC0; j++ ){
+                      if (int4) {
+                        weight_writer.write(pack_int4(WEIGHT(wy, wx, c*IC0_CHANNELS+2*i, koo*OC0 + j), WEIGHT(wy, wx, c*IC0_CHANNELS+2*i+1, koo*OC0 + j)));
+                      } else {
+                        weight_writer.write(WEIGHT(wy, wx, c*IC0+i, koo*OC0 + j));
                       }
-                      weight_stream.write(weight_tmp);
                     }  // for j
                 }  // for i
               }  // for wy
             }  // for wx
           }  // for k
+          weight_writer.end_tile();
         } // for koo
-      }  // for co
-    }  // for ko 
+    }  // for rep
+    if (params.WEIGHT_COMPRESSION != WEIGHT_COMPRESSION_NONE) {
+      printf("Compressed weights: %zu values streamed for %zu weights\n", weight_writer.streamed, weight_writer.values);
+    }
 
 
-    static ac_channel<uint_16> params_stream;
-    params_stream.write(params.OY1);
-    params_stream.write(params.OX1);
-    params_stream.write(params.OY0);
-    params_stream.write(params.OX0);
-    params_stream.write(params.OC1);
-    params_stream.write(params.IC1);
-    params_stream.write(params.FX);
-    params_stream.write(params.FY);
-    params_stream.write(params.STRIDE);
+    printf("Running reference C models\n");
+    // run reference model, a depthwise layer is the dense conv with diagonal weights
+    const size_t input_size = (size_t) IFMAP_HEIGHT * IFMAP_WIDTH * IFMAP_CHANNELS;
+    const size_t output_size = (size_t) OFMAP_HEIGHT * OFMAP_WIDTH * OFMAP_CHANNELS;
+    for (int n = 0; n < BATCH; n++) {
+      conv_gold_fast<IDTYPE,ODTYPE>(OFMAP_HEIGHT, OFMAP_WIDTH, OFMAP_CHANNELS, IFMAP_CHANNELS, FILTER_SIZE, STRIDE, &input[n * input_size], &weight[0], &output_ref[n * output_size]);
 
-    // Main function call
-    // launch hardware design
-    // conv *conv_design = new conv;
-    printf("Running HLS C design\n");
-    Conv conv_design;
-    conv_design.run(input_stream,weight_stream,output_stream, params_stream); 
+#if CONV_GOLD_CROSS_CHECK
+      conv_gold_tiled<IDTYPE,ODTYPE>(STRIDE, params.OY1,  params.OY0,  params.OX1,  params.OX0,  params.OC1,  OC0,  params.IC1,  IC0_CHANNELS,  params.FX,  params.FY, &input[n * input_size], &weight[0], &output_ref_tiled[n * output_size]);          
+      conv_gold<IDTYPE,ODTYPE>(OFMAP_HEIGHT, OFMAP_WIDTH, OFMAP_CHANNELS, IFMAP_CHANNELS, FILTER_SIZE, STRIDE, &input[n * input_size], &weight[0], &output_ref_naive[n * output_size]);          
 
-    printf("Running reference C models\n");
-    // run reference model
-    conv_gold_tiled<IDTYPE,ODTYPE,OFMAP_HEIGHT,OFMAP_WIDTH,OFMAP_CHANNELS,IFMAP_CHANNELS,FILTER_SIZE,STRIDE>(params.OY1,  params.OY0,  params.OX1,  params.OX0,  params.OC1,  OC0,  params.IC1,  IC0,  params.FX,  params.FY, input, weight, output_ref_tiled);          
-    conv_gold<IDTYPE,ODTYPE,OFMAP_HEIGHT,OFMAP_WIDTH,OFMAP_CHANNELS,IFMAP_CHANNELS,FILTER_SIZE,STRIDE>(input, weight, output_ref);          
+      for (int oy = 0; oy < OFMAP_HEIGHT; oy++) {
+        for (int ox = 0; ox < OFMAP_WIDTH; ox++) {
+          for (int oc = 0; oc < OFMAP_CHANNELS; oc++) {
+            if ((long long)OUTPUT_REF(output_ref, n, oy, ox, oc) != (long long)OUTPUT_REF(output_ref_naive, n, oy, ox, oc) ||
+                (long long)OUTPUT_REF(output_ref, n, oy, ox, oc) != (long long)OUTPUT_REF(output_ref_tiled, n, oy, ox, oc)) {
+              printf("***REFERENCE ERROR***\n");
+              printf("output[%d][%d][%d][%d], ref = %lld, ref naive = %lld, ref tiled = %lld\n", n, oy, ox, oc, (long long)OUTPUT_REF(output_ref, n, oy, ox, oc), (long long)OUTPUT_REF(output_ref_naive, n, oy, ox, oc), (long long)OUTPUT_REF(output_ref_tiled, n, oy, ox, oc));
+            }
+          }
+        }
+      }
+#endif
+    }  // for n
+
+    if (params.RESIDUAL) {
+      printf("Streaming Residual\n");
+      std::vector<IDTYPE> &residual = layer.residual;
+      residual.resize(output_ref.size());
+      for (size_t i = 0; i < residual.size(); i++) {
+        residual[i] = (IDTYPE) (rand() % 256 - 128);
+      }
+      residual_add_gold<IDTYPE,ODTYPE>(BATCH * OFMAP_HEIGHT, OFMAP_WIDTH, OFMAP_CHANNELS, params.RESIDUAL_SHIFT, &residual[0], &output_ref[0]);
+
+      // streamed in the order of the output tiles, see check_layer
+      SerialWriter<INPUT_PRECISION> residual_writer(residual_stream);
+      OutputTileCursor tile;
+      tile.reset();
+      for (int t = 0; t < params.OY1 * params.OX1 * params.OC1; t++) {
+        int ro = tile.oy1, co = tile.ox1, koo = tile.oc1;
+        tile.advance(params);
+        for (int n = 0; n < BATCH; n++) {
+          for (int p = 0; p < params.OY0; p++) {
+            for (int i = 0; i < params.OX0; i++) {
+              for (int j = 0; j < OC0; j++) {
+                residual_writer.write(OUTPUT_REF(residual, n, ro*params.OY0+p, co*params.OX0+i, koo*OC0+j));
+              }
+            }
+          }
+        }
+        residual_writer.end_tile();
+      }  // for t
+    }
+
+    layer.bias.assign(OFMAP_CHANNELS, 0);
+    layer.scale.assign(OFMAP_CHANNELS, 1);
+    layer.shift.assign(OFMAP_CHANNELS, 0);
+    if (params.REQUANTIZE) {
+      // random per channel constants, with the shift chosen such that the
+      // largest output of every channel lands just above the int8 range
+      for (int k = 0; k < OFMAP_CHANNELS; k++) {
+        int64_t max_abs = 0;
+        for (int i = 0; i < BATCH * OFMAP_HEIGHT * OFMAP_WIDTH; i++) {
+          int64_t value = (int32_t) output_ref[(size_t) i * OFMAP_CHANNELS + k];
+          max_abs = std::max(max_abs, value < 0 ? -value : value);
+        }
+        layer.bias[k] = (int32_t) (rand() % (2 * max_abs + 1) - max_abs);
+        layer.scale[k] = 1 + rand() % 32767;
+        int64_t range = (2 * max_abs + 1) * layer.scale[k];
+        layer.shift[k] = 0;
+        while ((range >> layer.shift[k]) > 256) {
+          layer.shift[k]++;
+        }
+      }
+    }
+    if (params.RELU || params.REQUANTIZE) {
+      // the images of the batch are post processed like one taller image
+      post_process_gold<ODTYPE>(BATCH * OFMAP_HEIGHT, OFMAP_WIDTH, OFMAP_CHANNELS, params.RELU, params.REQUANTIZE,
+                                &layer.bias[0], &layer.scale[0], &layer.shift[0], &output_ref[0]);
+    }
+    if (params.POOL != POOL_NONE) {
+      int pooled_height = pool_output_size(OFMAP_HEIGHT, params.POOL_SIZE.to_int(), params.POOL_STRIDE.to_int(), params.POOL_PAD.to_int());
+      int pooled_width = pool_output_size(OFMAP_WIDTH, params.POOL_SIZE.to_int(), params.POOL_STRIDE.to_int(), params.POOL_PAD.to_int());
+      const size_t pooled_size = (size_t) pooled_height * pooled_width * OFMAP_CHANNELS;
+      std::vector<ODTYPE> pooled(BATCH * pooled_size);
+      for (int n = 0; n < BATCH; n++) {
+        pool_gold<ODTYPE>(OFMAP_HEIGHT, OFMAP_WIDTH, OFMAP_CHANNELS, params.POOL.to_int(), params.POOL_SIZE.to_int(), params.POOL_STRIDE.to_int(), params.POOL_PAD.to_int(),
+                          params.POOL_SCALE.to_int(), params.POOL_SHIFT.to_int(), &output_ref[n * output_size], &pooled[n * pooled_size]);
+      }
+      output_ref.swap(pooled);
+    }
+
+    // layer descriptor, the design runs the queued descriptors back to back
+    write_descriptor(params, params_stream);
+    if (params.REQUANTIZE) {
+      for (int k = 0; k < OFMAP_CHANNELS; k++) {
+        params_stream.write(layer.bias[k] & 0xffff);
+        params_stream.write((layer.bias[k] >> 16) & 0xffff);
+        params_stream.write(layer.scale[k] & 0xffff);
+        params_stream.write(layer.shift[k]);
+      }
+    }
+
+    return 0;
+}
+
+// Reads the design output one word at a time, OUTPUT_LANES words arrive per beat
+struct OutputReader {
+    ac_channel<PackedInt<OUTPUT_PRECISION, OUTPUT_LANES> > &stream;
+    PackedInt<OUTPUT_PRECISION, OUTPUT_LANES> beat;
+    int lane;
+
+    OutputReader(ac_channel<PackedInt<OUTPUT_PRECISION, OUTPUT_LANES> > &stream) : stream(stream), lane(OUTPUT_LANES) {}
+
+    ODTYPE read(){
+      if (lane == OUTPUT_LANES) {
+        beat = stream.read();
+        lane = 0;
+      }
+      return beat.value[lane++];
+    }
+
+    // the rest of the last beat of a tile is padding
+    void end_tile(){
+      lane = OUTPUT_LANES;
+    }
+};
+
+// Compares the design output of one layer with its reference output
+int check_layer(ConvLayer &layer, ac_channel<PackedInt<OUTPUT_PRECISION, OUTPUT_LANES> > &output_stream,
+                ac_channel<uint_32> &skipped_stream, ac_channel<uint_16> &status_stream){
+    Params params = layer.params;
+    // the design reports the status of the descriptor, a rejected layer has no output
+    int status = status_stream.read().to_int();
+    if (status != layer.status) {
+      printf("***ERROR***\nstatus = %d, ref = %d\n", status, layer.status);
+      return 1;
+    }
+    if (status != PARAMS_STATUS_OK) {
+      if (status & PARAMS_STATUS_INPUT_BUFFER) {
+        printf("Layer rejected: N * IX0 * IY0 * IC1 exceeds INPUT_BUFFER_SIZE = %d\n", INPUT_BUFFER_SIZE);
+      }
+      if (status & PARAMS_STATUS_WEIGHT_BUFFER) {
+        printf("Layer rejected: the kernel tile rows exceed WEIGHT_BUFFER_SIZE = %d\n", WEIGHT_BUFFER_SIZE);
+      }
+      if (status & PARAMS_STATUS_ACCUMULATION_BUFFER) {
+        printf("Layer rejected: the output tile rows exceed ACCUMULATION_BUFFER_SIZE = %d\n", ACCUMULATION_BUFFER_SIZE);
+      }
+      if (status & PARAMS_STATUS_POST_PROCESS_TABLE) {
+        printf("Layer rejected: OC1 exceeds the %d requantized kernel tiles of OC1_TABLE_SIZE\n", OC1_TABLE_SIZE);
+      }
+      if (status & PARAMS_STATUS_POOL_BUFFER) {
+        printf("Layer rejected: the open pooled rows exceed POOL_ROWS = %d or POOL_BUFFER_SIZE = %d\n", POOL_ROWS, POOL_BUFFER_SIZE);
+      }
+      return 1;
+    }
+
+    const int OC0 = layer.OC0;
+    int OFMAP_HEIGHT = params.OY0 * params.OY1;
+    int OFMAP_WIDTH = params.OX0 * params.OX1;
+    const int OFMAP_CHANNELS = OC0 * params.OC1;
+    if (params.POOL != POOL_NONE) {
+      OFMAP_HEIGHT = pool_output_size(OFMAP_HEIGHT, params.POOL_SIZE.to_int(), params.POOL_STRIDE.to_int(), params.POOL_PAD.to_int());
+      OFMAP_WIDTH = pool_output_size(OFMAP_WIDTH, params.POOL_SIZE.to_int(), params.POOL_STRIDE.to_int(), params.POOL_PAD.to_int());
+    }
+    std::vector<ODTYPE> &output_ref = layer.output_ref;
+    int errCnt = 0;
+    OutputReader output_reader(output_stream);
 
     printf("\nChecking Output\n\n"); 
     // compare the hardware results with the reference model
-    for (int ro = 0; ro < params.OY1; ro++) {
-      for (int co = 0; co < params.OX1; co++) {
-        for(int koo = 0; koo < params.OC1; koo++){
-          for (int p = 0; p < params.OY0; p++ ){
-            for (int i = 0; i < params.OX0; i++ ){
+    // output tiles come out in the order selected by params.LOOP_ORDER, see OutputTileCursor
+    OutputTileCursor tile;
+    tile.reset();
+    for (int t = 0; t < params.OY1 * params.OX1 * params.OC1; t++) {
+          int ro = tile.oy1, co = tile.ox1, koo = tile.oc1;
+          tile.advance(params);
+          // rows and columns of the tile, the pooled outputs that end in it with pooling
+          PoolTileBounds by = {(uint_16) (ro*params.OY0), params.OY0};
+          PoolTileBounds bx = {(uint_16) (co*params.OX0), params.OX0};
+          if (params.POOL != POOL_NONE) {
+            by = pool_tile_bounds(ro, params.OY1.to_int(), params.OY0.to_int(), params.POOL_SIZE.to_int(), params.POOL_STRIDE.to_int(), params.POOL_PAD.to_int());
+            bx = pool_tile_bounds(co, params.OX1.to_int(), params.OX0.to_int(), params.POOL_SIZE.to_int(), params.POOL_STRIDE.to_int(), params.POOL_PAD.to_int());
+          }
+          // the rows of all images of the batch
+          for (int n = 0; n < params.N; n++ ){
+          for (int p = 0; p < by.count; p++ ){
+            for (int i = 0; i < bx.count; i++ ){
 
+              ODTYPE out_word;
               for (int j = 0; j < OC0; j++) {
                 
-               ODTYPE out_value = output_stream.read();
-
-                if ((long long)output_ref[ro*params.OY0+p][co*params.OX0+i][koo*OC0+j] != (long long)output_ref_tiled[ro*params.OY0+p][co*params.OX0+i][koo*OC0+j]) {
-                  printf("***REFERENCE ERROR***\n");
-                  printf("output[%d][%d][%d], ref = %lld, ref tiled = %lld\n",ro*params.OY0+p, co*params.OX0+i, koo*OC0+j, (long long)output_ref[ro*params.OY0+p][co*params.OX0+i][koo*OC0+j], (long long)output_ref_tiled[ro*params.OY0+p][co*params.OX0+i][koo*OC0+j]);
-                }
+               ODTYPE out_value;
+               if (params.REQUANTIZE) {
+                 // int8 outputs, 4 channels per word
+                 if (j % 4 == 0) {
+                   out_word = output_reader.read();
+                 }
+                 out_value = out_word.slc<INPUT_PRECISION>(INPUT_PRECISION * (j % 4));
+               } else {
+                 out_value = output_reader.read();
+               }
 
-                if((long long)output_ref[ro*params.OY0+p][co*params.OX0+i][koo*OC0+j] != (long long)out_value) {
+                if((long long)OUTPUT_REF(output_ref, n, by.first.to_int()+p, bx.first.to_int()+i, koo*OC0+j) != (long long)out_value) {
                   errCnt++;
                   if (errCnt < 10) {
                     printf("***ERROR***\n");
-                    printf("output[%d][%d][%d] = %lld, ref = %lld\n",ro*params.OY0+p, co*params.OX0+i, koo*OC0+j, (long long)out_value, (long long)output_ref[ro*params.OY0+p][co*params.OX0+i][koo*OC0+j]);
+                    printf("output[%d][%d][%d][%d] = %lld, ref = %lld\n", n, by.first.to_int()+p, bx.first.to_int()+i, koo*OC0+j, (long long)out_value, (long long)OUTPUT_REF(output_ref, n, by.first.to_int()+p, bx.first.to_int()+i, koo*OC0+j));
                   }
                 }
               }  // for j
             }  // for i
           }  // for p
-        } // for koo
-      }  // for co
-    }  // for ko
+          }  // for n
+          output_reader.end_tile();
+    }  // for t
+
+    uint32_t skipped_macs = skipped_stream.read().to_uint();
+    if (skipped_macs != layer.skipped_macs) {
+      errCnt++;
+      printf("***ERROR***\nskipped MACs = %u, ref = %u\n", skipped_macs, layer.skipped_macs);
+    }
+    printf("Skipped MACs for zero inputs: %u\n", skipped_macs);
     
     printf("\nThere were %d errors\n", errCnt);
     return errCnt;
 }
 
+#undef INPUT
+#undef WEIGHT
+#undef OUTPUT_REF
+
+// Runs the layers through one Conv instance. All layers are queued before the
+// design is launched, so with more than one layer the descriptors run back to back
+// and the double buffers load the next layer while the current one finishes.
+int run_layers(std::vector<ConvLayer> &layers){
+    static ac_channel<PackedInt<INPUT_PRECISION, SERIAL_LANES> > input_stream;
+    static ac_channel<PackedInt<WEIGHT_PRECISION, SERIAL_LANES> > weight_stream;
+    static ac_channel<PackedInt<INPUT_PRECISION, SERIAL_LANES> > residual_stream;
+    static ac_channel<PackedInt<OUTPUT_PRECISION, OUTPUT_LANES> > output_stream;
+    static ac_channel<uint_32> skipped_stream;
+    static ac_channel<uint_16> status_stream;
+    static ac_channel<uint_16> params_stream;
+
+    int errCnt = 0;
+    std::vector<int> layerErrCnt(layers.size(), 0);
+    for (unsigned l = 0; l < layers.size(); l++) {
+      printf("Layer %s\n", layers[l].name);
+      layerErrCnt[l] = queue_layer(layers[l], input_stream, weight_stream, residual_stream, params_stream);
+    }
+
+    // Main function call
+    // launch hardware design
+    // the design's buffers are MBs with wide arrays, so it lives on the heap
+    printf("Running HLS C design\n");
+    std::unique_ptr<Conv> conv_design(new Conv);
+    conv_design->run(input_stream,weight_stream,residual_stream,output_stream,skipped_stream,status_stream, params_stream); 
+
+    for (unsigned l = 0; l < layers.size(); l++) {
+      if (layerErrCnt[l] == 0) {
+        layerErrCnt[l] = check_layer(layers[l], output_stream, skipped_stream, status_stream);
+      }
+      printf("Layer %s: %s\n", layers[l].name, layerErrCnt[l] == 0 ? "PASSED" : "FAILED");
+      errCnt += layerErrCnt[l];
+    }
+    return errCnt;
+}
+
 CCS_MAIN(int argc, char *argv[]) 
 {
     int errCnt = 0;
     
-    Params params_resnet_layer = {
-        OY1,
-        OX1,
-        OY0,
-        OX0,
-        OC1,
-        IC1,
-        FX,
-        FY,
-        STRIDE
-    };
-    errCnt += run_layer<OY0 * OY1, OX0 * OX1, OC0 * OC1, IC0 * IC1, FX, STRIDE, IC0, OC0>(params_resnet_layer);
-    
-   //   printf("Layer 1\n");
-   //   Params params_resnet_layer_1 = {
-   //       8, // OY1
-   //       8, // OX1
-   //       14, // OY0
-   //       14, // OX0
-   //       4, // OC1 
-   //       4, // IC1
-   //       7, // FX
-   //       7, // FY
-   //       2 // STRIDE
-   //   };
-   //   errCnt += run_layer<112, 112, 64, 64, 7, 2, 16, 16>(params_resnet_layer_1);
-
-    // printf("Layer 2\n");
-    // Params params_resnet_layer_2 = {
-    //     4, // OY1
-    //     4, // OX1
-    //     14, // OY0
-    //     14, // OX0
-    //     4, // OC1 
-    //     4, // IC1
-    //     3, // FX
-    //     3, // FY
-    //     1 // STRIDE
-    // };
-    // errCnt += run_layer<56, 56, 64, 64, 3, 1, 16, 16>(params_resnet_layer_2);
-   
-    //  printf("Layer 3_1\n");
-    //  Params params_resnet_layer_3_1 = {
-    //      2, // OY1
-    //      2, // OX1
-    //      14, // OY0
-    //      14, // OX0
-    //      8, // OC1 
-    //      4, // IC1
-    //      3, // FX
-    //      3, // FY
-    //      2 // STRIDE
-    //  };
-    //  errCnt += run_layer<28, 28, 128, 64, 3, 2, 16, 16>(params_resnet_layer_3_1);
-
-    //  printf("Layer 3\n");
-    //  Params params_resnet_layer_3 = {
-    //      2, // OY1
-    //      2, // OX1
-    //      14, // OY0
-    //      14, // OX0
-    //      8, // OC1 
-    //      8, // IC1
-    //      3, // FX
-    //      3, // FY
-    //      1 // STRIDE
-    //  };
-    //  errCnt += run_layer<28, 28, 128, 128, 3, 1, 16, 16>(params_resnet_layer_3);
-      
-    //  printf("Layer 4_1\n");
-    //  Params params_resnet_layer_4_1 = {
-    //      2, // OY1
-    //      2, // OX1
-    //      7, // OY0
-    //      7, // OX0
-    //      16, // OC1 
-    //      8, // IC1
-    //      3, // FX
-    //      3, // FY
-    //      2 // STRIDE
-    //  };
-    //  errCnt += run_layer<14, 14, 256, 128, 3, 2, 16, 16>(params_resnet_layer_4_1);
-
-    //  printf("Layer 4\n");
-    //  Params params_resnet_layer_4 = {
-    //      1, // OY1
-    //      1, // OX1
-    //      14, // OY0
-    //      14, // OX0
-    //      16, // OC1 
-    //      16, // IC1
-    //      3, // FX
-    //      3, // FY
-    //      1 // STRIDE
-    //  };
-    //  errCnt += run_layer<14, 14, 256, 256, 3, 1, 16, 16>(params_resnet_layer_4);
-
-    //  printf("Layer 5_1\n");
-    //  Params params_resnet_layer_5_1 = {
-    //      1, // OY1
-    //      1, // OX1
-    //      7, // OY0
-    //      7, // OX0
-    //      32, // OC1 
-    //      16, // IC1
-    //      3, // FX
-    //      3, // FY
-    //      2 // STRIDE
-    //  };
-    //  errCnt += run_layer<7, 7, 512, 256, 3, 2, 16, 16>(params_resnet_layer_5_1);
-
-    //  printf("Layer 5\n");
-    // Params params_resnet_layer_5 = {
-    //     1, // OY1
-    //     1, // OX1
-    //     7, // OY0
-    //     7, // OX0
-    //     32, // OC1 
-    //     32, // IC1
-    //     3, // FX
-    //     3, // FY
-    //     1 // STRIDE
-    // };
-    // errCnt += run_layer<7, 7, 512, 512, 3, 1, 16, 16>(params_resnet_layer_5);
+    // --queue runs all layer files as one descriptor queue instead of one
+    // design run per layer
+    bool queue = false;
+    std::vector<ConvLayer> layers;
+    for (int l = 1; l < argc; l++) {
+      if (std::string(argv[l]) == "--queue") {
+        queue = true;
+        continue;
+      }
+      ConvLayer layer;
+      layer.name = argv[l];
+      if (!read_layer_params(argv[l], layer.params, layer.IC0, layer.OC0)) {
+        printf("Layer %s: FAILED\n", argv[l]);
+        errCnt++;
+        continue;
+      }
+      layers.push_back(layer);
+    }
+
+    if (argc == 1) {
+      // no layer files, e.g. under SCVerify: use the layer compiled in from conv_tb_params.h
+      Params params_resnet_layer = {
+          OY1,
+          OX1,
+          OY0,
+          OX0,
+          OC1,
+          IC1,
+          FX,
+          FY,
+          STRIDE,
+          LOOP_ORDER,
+          RELU,
+          REQUANTIZE,
+          PAD_TOP,
+          PAD_BOTTOM,
+          PAD_LEFT,
+          PAD_RIGHT,
+          N,
+          CONV_MODE,
+          RESIDUAL,
+          RESIDUAL_SHIFT,
+          POOL,
+          POOL_SIZE,
+          POOL_STRIDE,
+          POOL_PAD,
+          POOL_SCALE,
+          POOL_SHIFT,
+          PRECISION,
+          SPARSE,
+          WEIGHT_COMPRESSION
+      };
+      ConvLayer layer;
+      layer.name = "conv_tb_params.h";
+      layer.params = params_resnet_layer;
+      layer.IC0 = IC0;
+      layer.OC0 = OC0;
+      layers.push_back(layer);
+    }
+
+    if (queue) {
+      errCnt += run_layers(layers);
+    } else {
+      // sweep every layer with the same binary, one design run each
+      for (unsigned l = 0; l < layers.size(); l++) {
+        std::vector<ConvLayer> single(1, layers[l]);
+        errCnt += run_layers(single);
+      }
+    }
     
     if (errCnt == 0) {
       CCS_RETURN(0);
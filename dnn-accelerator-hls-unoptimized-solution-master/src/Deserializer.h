@@ -1,6 +1,38 @@
 #ifndef DESERIALIZER_H
 #define DESERIALIZER_H
 
+#include "WeightDoubleBuffer.h"
+#include "Pooler.h"
+
+// Buffers and tables the layer overflows, PARAMS_STATUS_OK when it fits
+inline uint_16 params_status(const Params &params)
+{
+    uint_16 status = PARAMS_STATUS_OK;
+    uint_32 ix0 = (params.OX0 - 1) * params.STRIDE + params.FX;
+    uint_32 iy0 = (params.OY0 - 1) * params.STRIDE + params.FY;
+    if (params.N * iy0 * ix0 * params.IC1 > INPUT_BUFFER_SIZE) {
+        status |= PARAMS_STATUS_INPUT_BUFFER;
+    }
+    if (weight_tile_rows<ARRAY_IC0>(params) > WEIGHT_BUFFER_SIZE) {
+        status |= PARAMS_STATUS_WEIGHT_BUFFER;
+    }
+    // a Winograd tile takes WINOGRAD_POSITIONS rows per 2x2 patch, see array_tile_rows
+    uint_32 tile_rows = params.N * params.OY0 * params.OX0;
+    if (params.CONV_MODE == CONV_MODE_WINOGRAD) {
+        tile_rows = tile_rows * (WINOGRAD_POSITIONS / 4);
+    }
+    if (tile_rows > ACCUMULATION_BUFFER_SIZE) {
+        status |= PARAMS_STATUS_ACCUMULATION_BUFFER;
+    }
+    if (params.REQUANTIZE && params.OC1 > OC1_TABLE_SIZE) {
+        status |= PARAMS_STATUS_POST_PROCESS_TABLE;
+    }
+    if (pool_buffer_overflow(params)) {
+        status |= PARAMS_STATUS_POOL_BUFFER;
+    }
+    return status;
+}
+
 template<typename DTYPE_SERIAL, typename DTYPE, int n>
 class Deserializer{
 public:
@@ -33,9 +65,20 @@ void CCS_BLOCK(run)(ac_channel<uint_16> &inputChannel,
                     ac_channel<Params> &outputChannel1,
                     ac_channel<Params> &outputChannel2,
                     ac_channel<Params> &outputChannel3,
-                    ac_channel<Params> &outputChannel4
+                    ac_channel<Params> &outputChannel4,
+                    ac_channel<Params> &outputChannel5,
+                    ac_channel<Params> &outputChannel6,
+                    ac_channel<Params> &outputChannel7,
+                    ac_channel<PostProcessRow<ARRAY_OC0> > &postProcessOut,
+                    ac_channel<uint_16> &statusOut
                     )
     {
+        // paramsIn is a queue of layer descriptors, each one is a full layer run
+        // back to back with the previous one
+        #ifndef __SYNTHESIS__
+        while(inputChannel.available(PARAMS_WORDS))
+        #endif
+        {
         Params params;
         
         params.OY1 = inputChannel.read();
@@ -47,12 +90,57 @@ void CCS_BLOCK(run)(ac_channel<uint_16> &inputChannel,
         params.FX = inputChannel.read();
         params.FY = inputChannel.read();
         params.STRIDE = inputChannel.read();
+        params.LOOP_ORDER = inputChannel.read();
+        params.RELU = inputChannel.read();
+        params.REQUANTIZE = inputChannel.read();
+        params.PAD_TOP = inputChannel.read();
+        params.PAD_BOTTOM = inputChannel.read();
+        params.PAD_LEFT = inputChannel.read();
+        params.PAD_RIGHT = inputChannel.read();
+        params.N = inputChannel.read();
+        params.CONV_MODE = inputChannel.read();
+        params.RESIDUAL = inputChannel.read();
+        params.RESIDUAL_SHIFT = inputChannel.read();
+        params.POOL = inputChannel.read();
+        params.POOL_SIZE = inputChannel.read();
+        params.POOL_STRIDE = inputChannel.read();
+        params.POOL_PAD = inputChannel.read();
+        params.POOL_SCALE = inputChannel.read();
+        params.POOL_SHIFT = inputChannel.read();
+        params.PRECISION = inputChannel.read();
+        params.SPARSE = inputChannel.read();
+        params.WEIGHT_COMPRESSION = inputChannel.read();
 
-        outputChannel1.write(params);
-        outputChannel2.write(params);
-        outputChannel3.write(params);
-        for (int i = 0; i < params.OX1 * params.OY1 * params.OC1; i++) {
+        // a layer that overflows a buffer does not run, see PARAMS_STATUS_OK
+        uint_16 status = params_status(params);
+        statusOut.write(status);
+        if (status == PARAMS_STATUS_OK) {
+            // one descriptor per block and layer, so the next layer's params reach
+            // the double buffers without waiting for this layer's output tiles
+            outputChannel1.write(params);
+            outputChannel2.write(params);
+            outputChannel3.write(params);
             outputChannel4.write(params);
+            outputChannel5.write(params);
+            outputChannel6.write(params);
+            outputChannel7.write(params);
+
+            // requantization constants follow the descriptor, one row per kernel tile
+            if (params.REQUANTIZE) {
+                for (int oc1 = 0; oc1 < params.OC1; oc1++) {
+                    PostProcessRow<ARRAY_OC0> row;
+                    for (int j = 0; j < ARRAY_OC0; j++) {
+                        ac_int<OUTPUT_PRECISION, true> bias;
+                        bias.set_slc(0, inputChannel.read());
+                        bias.set_slc(16, inputChannel.read());
+                        row.bias.value[j] = bias;
+                        row.scale.value[j] = inputChannel.read();
+                        row.shift[j] = inputChannel.read();
+                    }
+                    postProcessOut.write(row);
+                }
+            }
+        }
         }
     }
 
@@ -1,15 +1,61 @@
 #ifndef INPUT_DOUBLE_BUFFER_H
 #define INPUT_DOUBLE_BUFFER_H
 
+/*
+ * Zero padding (Params.PAD_*) is not streamed in: along each dimension only the part
+ * of a tile's input window inside the unpadded image is written to the buffer, and
+ * the reader produces zeros for the rest of the window.
+ */
+struct InputWindowBounds {
+    uint_16 first;  // first offset in the window that is inside the image
+    uint_16 count;  // number of offsets inside the image
+};
+
+// Bounds along one dimension for tile tile_idx out of num_tiles
+inline InputWindowBounds input_window_bounds(int tile_idx, int num_tiles, int tile_out, int stride,
+                                             int filter, int pad_lo, int pad_hi)
+{
+    int window = (tile_out - 1) * stride + filter;
+    int image = (num_tiles * tile_out - 1) * stride + filter - pad_lo - pad_hi;
+    // window start in unpadded image coordinates
+    int start = tile_idx * tile_out * stride - pad_lo;
+    int first = (start < 0) ? -start : 0;
+    int last = (start + window > image) ? image - start : window;
+
+    InputWindowBounds bounds;
+    bounds.first = first;
+    bounds.count = (last > first) ? last - first : 0;
+    return bounds;
+}
+
+/*
+ * Horizontally adjacent tiles share the last FX - STRIDE columns of a window, the
+ * halo. The writer keeps those columns on chip, and for every tile but the first
+ * of a row of tiles only the columns after the halo are streamed in.
+ */
+inline int input_halo_width(int stride, int filter)
+{
+    return (filter > stride) ? filter - stride : 0;
+}
+
+// Columns of the window inside the image that come from the halo of the previous tile
+inline int input_halo_columns(InputWindowBounds bx, int tile_idx, int halo)
+{
+    if (tile_idx == 0 || bx.first >= halo) {
+        return 0;
+    }
+    int last = (bx.first + bx.count < halo) ? (int) (bx.first + bx.count) : halo;
+    return last - bx.first;
+}
 
-template <int size, int IC0, int OC0>
+template <int size, int IC0, int OC0, int lanes, int cores>
 class InputDoubleBufferWriter{
 public:
     InputDoubleBufferWriter(){}
 
     #pragma hls_design interface
     void CCS_BLOCK(run)(ac_channel<Params> &paramsIn,
-                        ac_channel<PackedInt<INPUT_PRECISION, 4> > &din,
+                        ac_channel<PackedInt<INPUT_PRECISION, lanes> > &din,
                         ac_channel<chanStruct<PackedInt<INPUT_PRECISION,IC0>,size> > &dout)
     {
         #ifndef __SYNTHESIS__
@@ -21,10 +67,7 @@ public:
          * if we decided connect our module to a memory simulation that writes din sporadically the
          * module will fail on a non-blocking din read in a C sim without the guard.
          */
-        while (paramsIn.available(1) && din.available(
-                    (paramsIn[0].OX1.to_int() * paramsIn[0].OY1.to_int() * 
-                    ((paramsIn[0].OX0.to_int() - 1) * paramsIn[0].STRIDE.to_int() + paramsIn[0].FX.to_int()) *
-                    ((paramsIn[0].OY0.to_int() - 1) * paramsIn[0].STRIDE.to_int() + paramsIn[0].FY).to_int() * paramsIn[0].IC1.to_int()) / 4))
+        while (paramsIn.available(1) && din.available(layer_packets(paramsIn[0])))
         #endif
         {
             // -------------------------------
@@ -32,29 +75,85 @@ public:
             // -------------------------------
 
             Params params = paramsIn.read();
-            ac_int<ac::log2_ceil<size+1>::val, false> tileSize = ((params.OX0 - 1) * params.STRIDE + params.FX) * 
-                                ((params.OY0 - 1) * params.STRIDE + params.FY) * 
-                                params.IC1;
+            // weight stationary: the spatial tiles are streamed in again for every group
+            // of kernel tiles, see Multi-core in conv.h
+            uint_32 numTiles = params.OX1 * params.OY1;
+            if (params.LOOP_ORDER == LOOP_ORDER_WEIGHT_STATIONARY) {
+                numTiles = numTiles * kernel_tile_groups(params, cores);
+            }
+            uint_16 IY0 = (params.OY0 - 1) * params.STRIDE + params.FY;
+            uint_16 step = params.OX0 * params.STRIDE;  // window offset between adjacent tiles
+            uint_16 halo = input_halo_width(params.STRIDE.to_int(), params.FX.to_int());
+
+            uint_16 ox1 = 0;
+            uint_16 oy1 = 0;
             #pragma hls_pipeline_init_interval 1
-            TILES: for (int t = 0; t < params.OX1 * params.OY1; t++) {
+            TILES: for (int t = 0; t < numTiles; t++) {
                 chanStruct<PackedInt<INPUT_PRECISION,IC0>,size> tmp;
 
+                // only the part of the window inside the image is streamed in
+                InputWindowBounds bx = input_window_bounds(ox1.to_int(), params.OX1.to_int(), params.OX0.to_int(), params.STRIDE.to_int(),
+                                                           params.FX.to_int(), params.PAD_LEFT.to_int(), params.PAD_RIGHT.to_int());
+                InputWindowBounds by = input_window_bounds(oy1.to_int(), params.OY1.to_int(), params.OY0.to_int(), params.STRIDE.to_int(),
+                                                           params.FY.to_int(), params.PAD_TOP.to_int(), params.PAD_BOTTOM.to_int());
+                ac_int<ac::log2_ceil<size+1>::val, false> tileSize = bx.count * by.count * params.IC1 * params.N;
+
                 // record one tile in buffer
+                // each packet contains lanes values: a row takes IC0/lanes packets, or with
+                // lanes > IC0 a packet carries lanes/IC0 rows and the last one of a tile is padded
+                const int row_lanes = (lanes < IC0) ? lanes : IC0;
+                const int packets_per_row = IC0 / row_lanes;
+                const int rows_per_packet = lanes / row_lanes;
+                PackedInt<INPUT_PRECISION, IC0> memCol[rows_per_packet];  // columns in the memory
+                int row = rows_per_packet;  // rows of memCol already stored
+                // position in the padded window of the row being stored, plane
+                // counts the windows of the N images of every ic1 tile
+                uint_16 x = bx.first;
+                uint_16 y = by.first;
+                uint_16 plane = 0;
                 TILE: for (int i = 0; i < tileSize; i++) {
-                    PackedInt<INPUT_PRECISION, IC0> memCol;  // one column in the memory
-                    // each packet contains 4 values, pack IC0 tgt into one row
-                  //  #pragma hls_unroll yes
-                    for (int j = 0; j < IC0; j=j+4) {
-                        PackedInt<INPUT_PRECISION, 4> packet = din.read();
-                        #pragma hls_unroll yes
-                        for (int k = 0; k < 4; k++) {
-                            memCol.value[j+k] = packet.value[k];
+                    PackedInt<INPUT_PRECISION, IC0> value;
+                    uint_16 haloRow = halo * (y + IY0 * plane);
+                    if (ox1 != 0 && x < halo) {
+                        // shared with the previous tile
+                        value = haloMem[haloRow + x];
+                    } else {
+                        if (row == rows_per_packet) {
+                          //  #pragma hls_unroll yes
+                            for (int j = 0; j < packets_per_row; j++) {
+                                PackedInt<INPUT_PRECISION, lanes> packet = din.read();
+                                #pragma hls_unroll yes
+                                for (int k = 0; k < lanes; k++) {
+                                    memCol[k / row_lanes].value[j * row_lanes + k % row_lanes] = packet.value[k];
+                                }
+                            }
+                            row = 0;
+                        }
+                        value = memCol[row++];
+                    }
+                    tmp.data[i] = value;
+                    // the last columns of the window are the halo of the next tile
+                    if (x >= step) {
+                        haloMem[haloRow + x - step] = value;
+                    }
+
+                    if (++x == bx.first + bx.count) {
+                        x = bx.first;
+                        if (++y == by.first + by.count) {
+                            y = by.first;
+                            plane++;
                         }
                     }
-                    tmp.data[i] = memCol;
                 } // TILE
                 // write a tile
                 dout.write(tmp);
+
+                if (++ox1 == params.OX1) {
+                    ox1 = 0;
+                    if (++oy1 == params.OY1) {
+                        oy1 = 0;
+                    }
+                }
             } // TILES
 
             // -------------------------------
@@ -62,9 +161,37 @@ public:
             // -------------------------------
         }
     }
+
+private:
+    #ifndef __SYNTHESIS__
+    // packets streamed in for all tiles of a layer
+    static int layer_packets(Params params)
+    {
+        int packets = 0;
+        for (int oy1 = 0; oy1 < params.OY1; oy1++) {
+            for (int ox1 = 0; ox1 < params.OX1; ox1++) {
+                InputWindowBounds bx = input_window_bounds(ox1, params.OX1.to_int(), params.OX0.to_int(), params.STRIDE.to_int(),
+                                                           params.FX.to_int(), params.PAD_LEFT.to_int(), params.PAD_RIGHT.to_int());
+                InputWindowBounds by = input_window_bounds(oy1, params.OY1.to_int(), params.OY0.to_int(), params.STRIDE.to_int(),
+                                                           params.FY.to_int(), params.PAD_TOP.to_int(), params.PAD_BOTTOM.to_int());
+                int halo = input_halo_columns(bx, ox1, input_halo_width(params.STRIDE.to_int(), params.FX.to_int()));
+                packets += ((bx.count.to_int() - halo) * by.count.to_int() * params.IC1.to_int() * params.N.to_int() * IC0 + lanes - 1) / lanes;
+            }
+        }
+        return packets * (params.LOOP_ORDER == LOOP_ORDER_WEIGHT_STATIONARY ? kernel_tile_groups(params, cores).to_int() : 1);
+    }
+    #endif
+
+    // halo columns of the last tile, [IC1][N][IY0][halo]
+    PackedInt<INPUT_PRECISION, IC0> haloMem[size];
 };
 
-template <int size, int IC0, int OC0>
+/*
+ * The windows of a tile go out once per group of kernel tiles, on the dout channel
+ * of every core of the group, see Multi-core in conv.h. Depthwise kernel tiles read
+ * different input channels, there every kernel tile gets a copy on its own core.
+ */
+template <int size, int IC0, int OC0, int cores>
 class InputDoubleBufferReader{
 public:
     InputDoubleBufferReader(){}
@@ -72,10 +199,12 @@ public:
     #pragma hls_design interface
     void CCS_BLOCK(run)(ac_channel<Params> &paramsIn,
                         ac_channel<chanStruct<PackedInt<INPUT_PRECISION, IC0>,size> > &din, 
-                        ac_channel<PackedInt<INPUT_PRECISION, IC0> > &dout)
+                        ac_channel<PackedInt<INPUT_PRECISION, IC0> > dout[cores],
+                        ac_channel<PackedInt<INPUT_PRECISION, IC0> > doutHi[cores])
     {
         #ifndef __SYNTHESIS__
-        while (paramsIn.available(1) && din.available(paramsIn[0].OX1.to_int() * paramsIn[0].OY1.to_int()))
+        while (paramsIn.available(1) && din.available(paramsIn[0].OX1.to_int() * paramsIn[0].OY1.to_int() *
+                    (paramsIn[0].LOOP_ORDER == LOOP_ORDER_WEIGHT_STATIONARY ? kernel_tile_groups(paramsIn[0], cores).to_int() : 1)))
         #endif
         {
             // -------------------------------
@@ -83,35 +212,151 @@ public:
             // -------------------------------
 
             Params params = paramsIn.read();
-            uint_16 IX0 = (params.OX0 - 1) * params.STRIDE + params.FX;
-            uint_16 IY0 = (params.OY0 - 1) * params.STRIDE + params.FY;
 
+            // weight stationary: every tile is used by a single group of kernel tiles,
+            // since it is written again for each group
+            bool weight_stationary = (params.LOOP_ORDER == LOOP_ORDER_WEIGHT_STATIONARY);
+            uint_16 groups = kernel_tile_groups(params, cores);
+            uint_32 numTiles = params.OX1 * params.OY1;
+            if (weight_stationary) {
+                numTiles = numTiles * groups;
+            }
+
+            // depthwise: kernel tile oc1 only reads input channel tile oc1, and every
+            // window streams whole input rows instead of one position per output
+            bool depthwise = (params.CONV_MODE == CONV_MODE_DEPTHWISE);
+            uint_16 ic1_bound = params.IC1;
+            uint_16 fx_bound = params.FX;
+            uint_16 ox0_bound = params.OX0;
+            uint_16 x_step = params.STRIDE;
+            if (depthwise) {
+                ic1_bound = 1;
+                fx_bound = 1;
+                ox0_bound = (params.OX0 - 1) * params.STRIDE + params.FX;
+                x_step = 1;
+            }
+            // sparse: channel tile 2*ic1 goes out on dout and 2*ic1+1 on doutHi, the
+            // buffer is read at two addresses per step
+            bool sparse = (params.SPARSE != 0);
+            if (sparse) {
+                ic1_bound = params.IC1 / 2;
+            }
+
+            uint_16 ox1 = 0;
+            uint_16 oy1 = 0;
+            uint_16 tile_group = 0;  // first kernel tile of a weight stationary tile's group
             #pragma hls_pipeline_init_interval 1
-            TILES: for (int t = 0; t < params.OX1 * params.OY1; t++) {
+            TILES: for (int t = 0; t < numTiles; t++) {
                 chanStruct<PackedInt<INPUT_PRECISION, IC0>,size> tmp;
+
+                // copies of the tile: one per group, or per kernel tile if depthwise
+                uint_16 copies = groups;
+                if (depthwise) {
+                    copies = params.OC1;
+                }
+                if (weight_stationary) {
+                    copies = 1;
+                    if (depthwise) {
+                        copies = params.OC1 - tile_group;
+                        if (copies > cores) {
+                            copies = cores;
+                        }
+                    }
+                }
                 
                 // read one tile from memory, and pass out one address at a time in the correct order
                 tmp = din.read();
-                // OC1 reuses
-                OC1: for (int oc1 = 0; oc1 < params.OC1; oc1++) {
-                    IC1: for (int ic1 = 0; ic1 < params.IC1; ic1++) {
-                        FY: for (int fy = 0; fy < params.FY; fy++) {
-                            FX: for (int fx = 0; fx < params.FX; fx++) {
-                                OY0: for (int oy0 = 0; oy0 < params.OY0; oy0++) { 
-                                    #pragma hls_pipeline_init_interval 1
-                                    OX0: for (int ox0 = 0; ox0 < params.OX0; ox0++) { 
-                                        uint_16 address = 
-                                                params.STRIDE * ox0 + fx +
-                                                (params.STRIDE * oy0 + fy) * IX0 +
-                                                IY0 * IX0 * ic1;
-                                        dout.write(tmp.data[address]);
-
-                                    } // OX0
-                                } // OY0
-                            } // FX
-                        } // FY
-                    } // IC1
-                } // OC1
+                InputWindowBounds bx = input_window_bounds(ox1.to_int(), params.OX1.to_int(), params.OX0.to_int(), params.STRIDE.to_int(),
+                                                           params.FX.to_int(), params.PAD_LEFT.to_int(), params.PAD_RIGHT.to_int());
+                InputWindowBounds by = input_window_bounds(oy1.to_int(), params.OY1.to_int(), params.OY0.to_int(), params.STRIDE.to_int(),
+                                                           params.FY.to_int(), params.PAD_TOP.to_int(), params.PAD_BOTTOM.to_int());
+                // GEMM: the tile is the [IC1][N*OY0*OX0] input matrix, in the order
+                // the array reads it
+                if (params.CONV_MODE == CONV_MODE_GEMM) {
+                    uint_16 planeSize = params.N * params.OY0 * params.OX0;
+                    ac_int<ac::log2_ceil<size+1>::val, false> tileSize = ic1_bound * planeSize;
+                    GEMM_COPIES: for (int c = 0; c < copies; c++) {
+                        uint_16 first, last;
+                        copy_kernel_tiles(params, tile_group, c, depthwise, first, last);
+                        ac_int<ac::log2_ceil<size+1>::val, false> address = 0;
+                        uint_16 row = 0;  // row of the plane
+                        #pragma hls_pipeline_init_interval 1
+                        GEMM_ROWS: for (int i = 0; i < tileSize; i++) {
+                            broadcast(dout, first, last, tmp.data[address]);
+                            if (sparse) {
+                                broadcast(doutHi, first, last, tmp.data[address + planeSize]);
+                            }
+                            address++;
+                            if (sparse) {
+                                if (++row == planeSize) {
+                                    row = 0;
+                                    address += planeSize;
+                                }
+                            }
+                        } // GEMM_ROWS
+                    } // GEMM_COPIES
+                } else if (params.CONV_MODE == CONV_MODE_WINOGRAD) {
+                    // Winograd: the 4x4 input patch of every 2x2 output patch, row by
+                    // row, with the patches in (n, oy0/2, ox0/2) order
+                    WINOGRAD_COPIES: for (int c = 0; c < copies; c++) {
+                        uint_16 first, last;
+                        copy_kernel_tiles(params, tile_group, c, depthwise, first, last);
+                        WINOGRAD_IC1: for (int ic1 = 0; ic1 < params.IC1; ic1++) {
+                            WINOGRAD_N: for (int n = 0; n < params.N; n++) {
+                            WINOGRAD_PY: for (int py = 0; py < params.OY0 / 2; py++) {
+                                WINOGRAD_PX: for (int px = 0; px < params.OX0 / 2; px++) {
+                                    WINOGRAD_ROW: for (int i = 0; i < WINOGRAD_TILE; i++) {
+                                        #pragma hls_pipeline_init_interval 1
+                                        WINOGRAD_COL: for (int j = 0; j < WINOGRAD_TILE; j++) {
+                                            uint_16 x = 2 * px + j;
+                                            uint_16 y = 2 * py + i;
+                                            broadcast(dout, first, last, window_value(tmp, bx, by, x, y, n + params.N * ic1));
+                                        } // WINOGRAD_COL
+                                    } // WINOGRAD_ROW
+                                } // WINOGRAD_PX
+                            } // WINOGRAD_PY
+                            } // WINOGRAD_N
+                        } // WINOGRAD_IC1
+                    } // WINOGRAD_COPIES
+                } else {
+                    COPIES: for (int c = 0; c < copies; c++) {
+                        uint_16 first, last;
+                        copy_kernel_tiles(params, tile_group, c, depthwise, first, last);
+                        IC1: for (int ic1 = 0; ic1 < ic1_bound; ic1++) {
+                            uint_16 plane = sparse ? (uint_16) (2 * ic1) : (uint_16) ic1;
+                            if (depthwise) {
+                                plane = first;
+                            }
+                            FY: for (int fy = 0; fy < params.FY; fy++) {
+                                FX: for (int fx = 0; fx < fx_bound; fx++) {
+                                    N: for (int n = 0; n < params.N; n++) {
+                                    OY0: for (int oy0 = 0; oy0 < params.OY0; oy0++) { 
+                                        #pragma hls_pipeline_init_interval 1
+                                        OX0: for (int ox0 = 0; ox0 < ox0_bound; ox0++) { 
+                                            // position in the padded window
+                                            uint_16 x = x_step * ox0 + fx;
+                                            uint_16 y = params.STRIDE * oy0 + fy;
+                                            broadcast(dout, first, last, window_value(tmp, bx, by, x, y, n + params.N * plane));
+                                            if (sparse) {
+                                                broadcast(doutHi, first, last, window_value(tmp, bx, by, x, y, n + params.N * (plane + 1)));
+                                            }
+
+                                        } // OX0
+                                    } // OY0
+                                    } // N
+                                } // FX
+                            } // FY
+                        } // IC1
+                    } // COPIES
+                }
+
+                if (++ox1 == params.OX1) {
+                    ox1 = 0;
+                    if (++oy1 == params.OY1) {
+                        oy1 = 0;
+                        tile_group += cores;
+                    }
+                }
             } // TILES
 
             // -------------------------------
@@ -119,16 +364,70 @@ public:
             // -------------------------------
         }
     }
+
+private:
+    // The value at (x, y) of the padded window in window plane (image n of channel
+    // tile ic1 at n + N*ic1), zero outside the image
+    static PackedInt<INPUT_PRECISION, IC0> window_value(chanStruct<PackedInt<INPUT_PRECISION, IC0>,size> &tmp,
+                                                       InputWindowBounds bx, InputWindowBounds by,
+                                                       uint_16 x, uint_16 y, uint_16 plane)
+    {
+        PackedInt<INPUT_PRECISION, IC0> value;
+        #pragma hls_unroll yes
+        for (int i = 0; i < IC0; i++) {
+            value.value[i] = 0;
+        }
+        if (x >= bx.first && x < bx.first + bx.count && y >= by.first && y < by.first + by.count) {
+            uint_16 address = (x - bx.first) + (y - by.first) * bx.count + by.count * bx.count * plane;
+            value = tmp.data[address];
+        }
+        return value;
+    }
+
+    // Kernel tiles [first, last) served by copy c of a tile, tile_group is the
+    // group of a weight stationary tile
+    static void copy_kernel_tiles(const Params &params, uint_16 tile_group, int c, bool depthwise,
+                                  uint_16 &first, uint_16 &last)
+    {
+        first = 0;
+        if (params.LOOP_ORDER == LOOP_ORDER_WEIGHT_STATIONARY) {
+            first = tile_group;
+        }
+        if (depthwise) {
+            first += c;
+            last = first + 1;
+        } else {
+            first += c * cores;
+            last = first + cores;
+            if (last > params.OC1) {
+                last = params.OC1;
+            }
+        }
+    }
+
+    // Sends value to the cores of kernel tiles [first, last), all in one group
+    static void broadcast(ac_channel<PackedInt<INPUT_PRECISION, IC0> > dout[cores], uint_16 first, uint_16 last,
+                          PackedInt<INPUT_PRECISION, IC0> value)
+    {
+        uint_16 group = first - first % cores;
+        #pragma hls_unroll yes
+        for (int k = 0; k < cores; k++) {
+            if (group + k >= first && group + k < last) {
+                dout[k].write(value);
+            }
+        }
+    }
 };
 
-template <int size, int IC0, int OC0>
+template <int size, int IC0, int OC0, int lanes, int cores>
 class InputDoubleBuffer{
 public:
   InputDoubleBuffer(){}
 
   #pragma hls_design interface
-  void CCS_BLOCK(run)(ac_channel<PackedInt<INPUT_PRECISION, 4> > &inputs_in, 
-                      ac_channel<PackedInt<INPUT_PRECISION, IC0> > &inputs_out,
+  void CCS_BLOCK(run)(ac_channel<PackedInt<INPUT_PRECISION, lanes> > &inputs_in, 
+                      ac_channel<PackedInt<INPUT_PRECISION, IC0> > inputs_out[cores],
+                      ac_channel<PackedInt<INPUT_PRECISION, IC0> > inputs_hi_out[cores],
                       ac_channel<Params> &paramsIn)
     {
 
@@ -143,17 +442,17 @@ public:
 
             inputDoubleBufferWriter.run(inputDoubleBufferWriterParams, inputs_in, mem);
 
-            inputDoubleBufferReader.run(inputDoubleBufferReaderParams, mem, inputs_out);
+            inputDoubleBufferReader.run(inputDoubleBufferReaderParams, mem, inputs_out, inputs_hi_out);
         }
     }
 
 private:
     ac_channel<chanStruct<PackedInt<INPUT_PRECISION, IC0>,size> > mem;
     
-    InputDoubleBufferWriter<size, IC0, OC0> inputDoubleBufferWriter;
+    InputDoubleBufferWriter<size, IC0, OC0, lanes, cores> inputDoubleBufferWriter;
     ac_channel<Params> inputDoubleBufferWriterParams;
     
-    InputDoubleBufferReader<size, IC0, OC0> inputDoubleBufferReader;
+    InputDoubleBufferReader<size, IC0, OC0, cores> inputDoubleBufferReader;
     ac_channel<Params> inputDoubleBufferReaderParams;
 };
 
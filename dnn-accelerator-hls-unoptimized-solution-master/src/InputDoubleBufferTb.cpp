@@ -29,6 +29,7 @@ int run_layer(Params params) {
 
     static ac_channel<PackedInt<INPUT_PRECISION, 4> > inputs_in_stream;
     static ac_channel<PackedInt<INPUT_PRECISION, IC0> > inputs_out_stream;
+    static ac_channel<PackedInt<INPUT_PRECISION, IC0> > inputs_hi_out_stream;
     static ac_channel<Params> params_stream;
     
     int errCnt = 0;
@@ -50,6 +51,10 @@ int run_layer(Params params) {
         for (int c=0; c< params.IC1; c++) {
           for (int p = 0; p < STRIDE*(params.OY0-1) + FILTER_SIZE; p++ ){
             for (int j = 0; j < (STRIDE*(params.OX0-1) + FILTER_SIZE); j++ ){
+              // the halo columns shared with the previous tile are already on chip
+              if (co != 0 && j < FILTER_SIZE - STRIDE) {
+                continue;
+              }
               for (int i = 0; i < IC0/4; i++ ){
                 PackedInt<INPUT_PRECISION, 4> input_tmp;
                 for(int ii = 0; ii < 4; ii++){
@@ -67,8 +72,8 @@ int run_layer(Params params) {
 
     // Run HLS
     printf("Running HLS C design\n");
-    InputDoubleBuffer<INPUT_BUFFER_SIZE, IC0, OC0> inputdoublebuffer_dut;
-    inputdoublebuffer_dut.run(inputs_in_stream, inputs_out_stream, params_stream); 
+    InputDoubleBuffer<INPUT_BUFFER_SIZE, IC0, OC0, 4, 1> inputdoublebuffer_dut;
+    inputdoublebuffer_dut.run(inputs_in_stream, &inputs_out_stream, &inputs_hi_out_stream, params_stream); 
 
     printf("Loading correct comparison\n");
 
@@ -133,7 +138,27 @@ CCS_MAIN(int argc, char *argv[])
         IC1,
         FX,
         FY,
-        STRIDE
+        STRIDE,
+        LOOP_ORDER,
+        RELU,
+        REQUANTIZE,
+        PAD_TOP,
+        PAD_BOTTOM,
+        PAD_LEFT,
+        PAD_RIGHT,
+        N,
+        CONV_MODE,
+        RESIDUAL,
+        RESIDUAL_SHIFT,
+        POOL,
+        POOL_SIZE,
+        POOL_STRIDE,
+        POOL_PAD,
+        POOL_SCALE,
+        POOL_SHIFT,
+        PRECISION,
+        SPARSE,
+        WEIGHT_COMPRESSION
     };
     errCnt += run_layer<OY0 * OY1, OX0 * OX1, OC0 * OC1, IC0 * IC1, FX, STRIDE, IC0, OC0>(params_resnet_layer);
     
@@ -0,0 +1,295 @@
+#ifndef POOLER_H
+#define POOLER_H
+
+/*
+ * Pooling (Params.POOL) of the conv outputs: pooled output p of a dimension covers
+ * the conv outputs [p*POOL_STRIDE - POOL_PAD, p*POOL_STRIDE - POOL_PAD + POOL_SIZE),
+ * the positions outside the conv output are left out. A pooled output leaves with
+ * the conv tile that holds the last position of its window, so the output tiles
+ * keep the tile order of the conv, only with fewer rows.
+ */
+struct PoolTileBounds {
+    uint_16 first;  // first pooled output that ends in the tile
+    uint_16 count;  // number of pooled outputs that end in the tile
+};
+
+// Pooled outputs along one dimension of conv_out conv outputs
+inline int pool_output_size(int conv_out, int pool_size, int stride, int pad)
+{
+    return (conv_out + 2 * pad - pool_size) / stride + 1;
+}
+
+// First pooled output whose window ends at or after conv output conv_idx
+inline int pool_first_ending(int conv_idx, int pool_size, int stride, int pad, int pooled)
+{
+    int start = conv_idx + pad - pool_size + 1;
+    int first = (start <= 0) ? 0 : (start + stride - 1) / stride;
+    return (first < pooled) ? first : pooled;
+}
+
+// Bounds along one dimension for conv tile tile_idx out of num_tiles
+inline PoolTileBounds pool_tile_bounds(int tile_idx, int num_tiles, int tile_out, int pool_size,
+                                       int stride, int pad)
+{
+    int pooled = pool_output_size(num_tiles * tile_out, pool_size, stride, pad);
+    int first = (tile_idx == 0) ? 0 : pool_first_ending(tile_idx * tile_out, pool_size, stride, pad, pooled);
+    int last = (tile_idx == num_tiles - 1) ? pooled : pool_first_ending((tile_idx + 1) * tile_out, pool_size, stride, pad, pooled);
+
+    PoolTileBounds bounds;
+    bounds.first = first;
+    bounds.count = last - first;
+    return bounds;
+}
+
+// The pooled rows with a window in one row of tiles are all open at once: more than
+// POOL_ROWS of them, or POOL_ROWS rows of all kernel tiles and images beyond
+// POOL_BUFFER_SIZE, do not fit in the Pooler's buffer
+inline bool pool_buffer_overflow(const Params &params)
+{
+    if (params.POOL == POOL_NONE || params.POOL_STRIDE == 0) {
+        return false;
+    }
+    const int pool_size = params.POOL_SIZE.to_int();
+    const int pool_stride = params.POOL_STRIDE.to_int();
+    const int pool_pad = params.POOL_PAD.to_int();
+    const int tile_height = params.OY0.to_int();
+    int pooled_height = pool_output_size(params.OY1 * params.OY0, pool_size, pool_stride, pool_pad);
+    int pooled_width = pool_output_size(params.OX1 * params.OX0, pool_size, pool_stride, pool_pad);
+    int open_rows = 0;
+    for (int oy1 = 0; oy1 < params.OY1; oy1++) {
+        int first = pool_first_ending(oy1 * tile_height, pool_size, pool_stride, pool_pad, pooled_height);
+        int last = ((oy1 + 1) * tile_height - 1 + pool_pad) / pool_stride;
+        if (last > pooled_height - 1) {
+            last = pooled_height - 1;
+        }
+        if (last - first + 1 > open_rows) {
+            open_rows = last - first + 1;
+        }
+    }
+    return open_rows > POOL_ROWS ||
+           params.OC1 * params.N * (POOL_ROWS / 2) * ((pooled_width + 1) / 2) > POOL_BUFFER_SIZE;
+}
+
+// Rows of the output tile at (oy1, ox1), (n, py, px) order with pooling
+inline uint_16 output_tile_rows(const Params &params, uint_16 oy1, uint_16 ox1)
+{
+    if (params.POOL == POOL_NONE) {
+        return params.N * params.OY0 * params.OX0;
+    }
+    PoolTileBounds by = pool_tile_bounds(oy1.to_int(), params.OY1.to_int(), params.OY0.to_int(), params.POOL_SIZE.to_int(),
+                                         params.POOL_STRIDE.to_int(), params.POOL_PAD.to_int());
+    PoolTileBounds bx = pool_tile_bounds(ox1.to_int(), params.OX1.to_int(), params.OX0.to_int(), params.POOL_SIZE.to_int(),
+                                         params.POOL_STRIDE.to_int(), params.POOL_PAD.to_int());
+    return params.N * by.count * bx.count;
+}
+
+// Position of the current output tile, advanced in the order of Params.LOOP_ORDER.
+// In weight stationary order the ARRAY_CORES kernel tiles of a group run side by side,
+// so the tiles of a group go (oy1, ox1, oc1), see Multi-core in conv.h.
+struct OutputTileCursor {
+    uint_16 oy1;
+    uint_16 ox1;
+    uint_16 oc1;
+    uint_16 group;  // first kernel tile of the group, weight stationary only
+
+    void reset() {
+        oy1 = 0;
+        ox1 = 0;
+        oc1 = 0;
+        group = 0;
+    }
+
+    void advance(const Params &params) {
+        if (params.LOOP_ORDER == LOOP_ORDER_WEIGHT_STATIONARY) {
+            if (++oc1 != params.OC1 && oc1 != group + ARRAY_CORES) {
+                return;
+            }
+            oc1 = group;
+            if (++ox1 == params.OX1) {
+                ox1 = 0;
+                if (++oy1 == params.OY1) {
+                    oy1 = 0;
+                    group += ARRAY_CORES;
+                    oc1 = group;
+                }
+            }
+        } else {
+            if (++oc1 == params.OC1) {
+                oc1 = 0;
+                if (++ox1 == params.OX1) {
+                    ox1 = 0;
+                    oy1++;
+                }
+            }
+        }
+    }
+};
+
+// Position along one dimension relative to the pooled window that starts last:
+// window p = c + POOL_PAD div POOL_STRIDE, offset = c + POOL_PAD mod POOL_STRIDE
+struct PoolWindowCursor {
+    uint_16 p;
+    uint_16 offset;
+
+    void reset(int conv_idx, int stride, int pad) {
+        p = (conv_idx + pad) / stride;
+        offset = (conv_idx + pad) % stride;
+    }
+
+    void advance(const Params &params) {
+        if (++offset == params.POOL_STRIDE) {
+            offset = 0;
+            p++;
+        }
+    }
+};
+
+/*
+ * Pooling stage between the PostProcessor and the serializer. Windows that span
+ * several tiles are kept as partial max/sum in poolMem until their last position
+ * arrives, for POOL_ROWS pooled rows per kernel tile and image (a ring over the
+ * pooled rows). With POOL_SIZE <= 2*POOL_STRIDE a position is in at most 2x2
+ * windows, one of each (row, column) parity, so poolMem is split into 4 banks
+ * that are each read and written once per position.
+ */
+template <int OC0, int size, int rows>
+class Pooler{
+public:
+    Pooler(){}
+
+    #pragma hls_design interface
+    void CCS_BLOCK(run)(ac_channel<PackedInt<OUTPUT_PRECISION, OC0> > &inputChannel,
+                        ac_channel<PackedInt<OUTPUT_PRECISION, OC0> > &outputChannel,
+                        ac_channel<Params> &paramsIn)
+    {
+        #ifndef __SYNTHESIS__
+        while(paramsIn.available(1))
+        #endif
+        {
+            Params params = paramsIn.read();
+
+            uint_16 height = params.OY1 * params.OY0;
+            uint_16 width = params.OX1 * params.OX0;
+            uint_16 pooled_height = pool_output_size(height.to_int(), params.POOL_SIZE.to_int(), params.POOL_STRIDE.to_int(), params.POOL_PAD.to_int());
+            uint_16 pooled_width = pool_output_size(width.to_int(), params.POOL_SIZE.to_int(), params.POOL_STRIDE.to_int(), params.POOL_PAD.to_int());
+            // entries of a pooled row in one bank
+            uint_16 bank_width = (pooled_width + 1) / 2;
+            uint_16 tile_size = params.N * params.OX0 * params.OY0;
+            uint_32 num_tiles = params.OX1 * params.OY1 * params.OC1;
+
+            OutputTileCursor tile;
+            tile.reset();
+            for (uint_32 t = 0; t < num_tiles; t++) {
+                uint_16 y0 = tile.oy1 * params.OY0;
+                uint_16 x0 = tile.ox1 * params.OX0;
+                PoolWindowCursor wy, wx;
+                wy.reset(y0.to_int(), params.POOL_STRIDE.to_int(), params.POOL_PAD.to_int());
+                wx.reset(x0.to_int(), params.POOL_STRIDE.to_int(), params.POOL_PAD.to_int());
+                PoolWindowCursor wx_row = wx;  // at the start of every row of the tile
+                PoolWindowCursor wy_image = wy;  // at the start of every image of the tile
+                uint_16 y = y0, x = x0, n = 0;
+
+                #pragma hls_pipeline_init_interval 1
+                for (uint_16 i = 0; i < tile_size; i++) {
+                    PackedInt<OUTPUT_PRECISION, OC0> input = inputChannel.read();
+                    if (params.POOL == POOL_NONE) {
+                        outputChannel.write(input);
+                        continue;
+                    }
+
+                    bool emit = false;
+                    PackedInt<OUTPUT_PRECISION, OC0> output;
+                    #pragma hls_unroll yes
+                    for (int dy = 0; dy < 2; dy++) {
+                        // dy = 0: the window starting last, dy = 1: the one before
+                        uint_16 py = wy.p - dy;
+                        uint_16 row_offset = wy.offset + dy * params.POOL_STRIDE;
+                        bool row_in = (wy.p >= dy) && (py < pooled_height) && (row_offset < params.POOL_SIZE);
+                        bool row_first = (row_offset == 0) || (y == 0);
+                        bool row_last = (row_offset == params.POOL_SIZE - 1) || (y == height - 1);
+                        #pragma hls_unroll yes
+                        for (int dx = 0; dx < 2; dx++) {
+                            uint_16 px = wx.p - dx;
+                            uint_16 col_offset = wx.offset + dx * params.POOL_STRIDE;
+                            bool col_in = (wx.p >= dx) && (px < pooled_width) && (col_offset < params.POOL_SIZE);
+                            bool col_first = (col_offset == 0) || (x == 0);
+                            bool col_last = (col_offset == params.POOL_SIZE - 1) || (x == width - 1);
+                            if (row_in && col_in) {
+                                uint_16 slot = (py >> 1) & (rows / 2 - 1);
+                                uint_32 addr = ((tile.oc1 * params.N + n) * (rows / 2) + slot) * bank_width + (px >> 1);
+                                PackedInt<OUTPUT_PRECISION, OC0> partial = poolMem[py & 1][px & 1][addr];
+                                PackedInt<OUTPUT_PRECISION, OC0> value;
+                                #pragma hls_unroll yes
+                                for (int j = 0; j < OC0; j++) {
+                                    ac_int<OUTPUT_PRECISION, true> in = input.value[j];
+                                    ac_int<OUTPUT_PRECISION, true> acc = partial.value[j];
+                                    if (row_first && col_first) {
+                                        acc = in;
+                                    } else if (params.POOL == POOL_MAX) {
+                                        acc = (in > acc) ? in : acc;
+                                    } else {
+                                        acc += in;
+                                    }
+                                    value.value[j] = acc;
+                                }
+                                // with POOL_PAD < POOL_STRIDE only one window ends here
+                                if (row_last && col_last) {
+                                    emit = true;
+                                    output = value;
+                                } else {
+                                    poolMem[py & 1][px & 1][addr] = value;
+                                }
+                            }
+                        }
+                    }
+                    if (emit) {
+                        if (params.POOL == POOL_AVG) {
+                            #pragma hls_unroll yes
+                            for (int j = 0; j < OC0; j++) {
+                                output.value[j] = average(output.value[j], params.POOL_SCALE, params.POOL_SHIFT);
+                            }
+                        }
+                        outputChannel.write(output);
+                    }
+
+                    // next position of the tile, (n, oy0, ox0) order
+                    if (x == x0 + params.OX0 - 1) {
+                        x = x0;
+                        wx = wx_row;
+                        if (y == y0 + params.OY0 - 1) {
+                            y = y0;
+                            wy = wy_image;
+                            n++;
+                        } else {
+                            y++;
+                            wy.advance(params);
+                        }
+                    } else {
+                        x++;
+                        wx.advance(params);
+                    }
+                }
+                tile.advance(params);
+            }
+        }
+    }
+
+private:
+    // round(sum * scale / 2^shift), scale ~ 2^shift / POOL_SIZE^2
+    ac_int<OUTPUT_PRECISION, true> average(ac_int<OUTPUT_PRECISION, true> sum,
+                                           ac_int<POOL_SCALE_PRECISION, false> scale,
+                                           ac_int<POOL_SHIFT_PRECISION, false> shift)
+    {
+        ac_int<OUTPUT_PRECISION+POOL_SCALE_PRECISION+1, true> product = sum * scale;
+        ac_int<OUTPUT_PRECISION+POOL_SCALE_PRECISION+1, true> rounding = 0;
+        if (shift != 0) {
+            rounding.set_slc(shift - 1, (ac_int<1, false>) 1);
+        }
+        ac_int<OUTPUT_PRECISION, true> result = (product + rounding) >> shift;
+        return result;
+    }
+
+    PackedInt<OUTPUT_PRECISION, OC0> poolMem[2][2][size];
+};
+
+#endif
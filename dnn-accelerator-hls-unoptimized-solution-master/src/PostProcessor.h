@@ -0,0 +1,127 @@
+#ifndef POST_PROCESSOR_H
+#define POST_PROCESSOR_H
+
+/*
+ * Output stage between the systolic array and the serializer: residual add,
+ * per output channel bias, fixed point scale/shift requantization to int8 and
+ * ReLU, see Params.RESIDUAL / Params.RELU / Params.REQUANTIZE in conv.h.
+ * The constants of all OC1 kernel tiles of a layer are kept in a table since
+ * the tiles of one kernel tile are not consecutive in the spatial outer loop order.
+ */
+template <int OC0, int oc1size, int lanes>
+class PostProcessor{
+public:
+    PostProcessor(){}
+
+    #pragma hls_design interface
+    void CCS_BLOCK(run)(ac_channel<PackedInt<OUTPUT_PRECISION, OC0> > &inputChannel,
+                        ac_channel<PackedInt<INPUT_PRECISION, lanes> > &residualChannel,
+                        ac_channel<PackedInt<OUTPUT_PRECISION, OC0> > &outputChannel,
+                        ac_channel<Params> &paramsIn,
+                        ac_channel<PostProcessRow<OC0> > &postProcessIn)
+    {
+        #ifndef __SYNTHESIS__
+        while(paramsIn.available(1))
+        #endif
+        {
+            Params params = paramsIn.read();
+
+            if (params.REQUANTIZE) {
+                for (int oc1 = 0; oc1 < params.OC1; oc1++) {
+                    table[oc1] = postProcessIn.read();
+                }
+            }
+
+            // tile order of the merged array outputs
+            uint_32 num_tiles = params.OX1 * params.OY1 * params.OC1;
+            uint_16 tile_size = params.N * params.OX0 * params.OY0;
+
+            OutputTileCursor tile;
+            tile.reset();
+            for (uint_32 t = 0; t < num_tiles; t++) {
+                // the table only holds the kernel tiles of requantized layers
+                PostProcessRow<OC0> row;
+                if (params.REQUANTIZE) {
+                    row = table[tile.oc1];
+                }
+
+                // residual rows arrive packed like input_serial, a row takes OC0/lanes
+                // packets or a packet carries lanes/OC0 rows, the last one of a tile padded
+                const int row_lanes = (lanes < OC0) ? lanes : OC0;
+                const int packets_per_row = OC0 / row_lanes;
+                const int rows_per_packet = lanes / row_lanes;
+                PackedInt<INPUT_PRECISION, OC0> residualRows[rows_per_packet];
+                int residualRow = rows_per_packet;  // rows of residualRows already used
+
+                #pragma hls_pipeline_init_interval 1
+                for (uint_16 i = 0; i < tile_size; i++) {
+                    PackedInt<OUTPUT_PRECISION, OC0> input = inputChannel.read();
+                    PackedInt<INPUT_PRECISION, OC0> residual;
+                    if (params.RESIDUAL) {
+                        if (residualRow == rows_per_packet) {
+                            for (int j = 0; j < packets_per_row; j++) {
+                                PackedInt<INPUT_PRECISION, lanes> packet = residualChannel.read();
+                                #pragma hls_unroll yes
+                                for (int k = 0; k < lanes; k++) {
+                                    residualRows[k / row_lanes].value[j * row_lanes + k % row_lanes] = packet.value[k];
+                                }
+                            }
+                            residualRow = 0;
+                        }
+                        residual = residualRows[residualRow++];
+                    }
+                    PackedInt<OUTPUT_PRECISION, OC0> output;
+                    #pragma hls_unroll yes
+                    for (int j = 0; j < OC0; j++) {
+                        ac_int<OUTPUT_PRECISION, true> value = input.value[j];
+                        if (params.RESIDUAL) {
+                            // the shortcut is brought to the scale of the accumulator
+                            ac_int<OUTPUT_PRECISION, true> shortcut = residual.value[j];
+                            value += shortcut << params.RESIDUAL_SHIFT;
+                        }
+                        if (params.REQUANTIZE) {
+                            value = requantize(value, row.bias.value[j], row.scale.value[j], row.shift[j]);
+                        }
+                        if (params.RELU && value < 0) {
+                            value = 0;
+                        }
+                        output.value[j] = value;
+                    }
+                    outputChannel.write(output);
+                }
+                tile.advance(params);
+            }
+        }
+    }
+
+private:
+    // saturate_int8(round((acc + bias) * scale / 2^shift))
+    ac_int<OUTPUT_PRECISION, true> requantize(ac_int<OUTPUT_PRECISION, true> acc,
+                                              ac_int<OUTPUT_PRECISION, true> bias,
+                                              ac_int<POST_PROCESS_SCALE_PRECISION, true> scale,
+                                              ac_int<POST_PROCESS_SHIFT_PRECISION, false> shift)
+    {
+        ac_int<OUTPUT_PRECISION+1, true> sum = acc + bias;
+        ac_int<OUTPUT_PRECISION+1+POST_PROCESS_SCALE_PRECISION, true> product = sum * scale;
+        ac_int<OUTPUT_PRECISION+1+POST_PROCESS_SCALE_PRECISION, true> rounding = 0;
+        if (shift != 0) {
+            rounding.set_slc(shift - 1, (ac_int<1, false>) 1);
+        }
+        ac_int<OUTPUT_PRECISION+1+POST_PROCESS_SCALE_PRECISION, true> scaled = (product + rounding) >> shift;
+
+        // saturate to the range of the next layer's inputs
+        const int out_max = (1 << (INPUT_PRECISION - 1)) - 1;
+        const int out_min = -(1 << (INPUT_PRECISION - 1));
+        ac_int<OUTPUT_PRECISION, true> result = scaled;
+        if (scaled > out_max) {
+            result = out_max;
+        } else if (scaled < out_min) {
+            result = out_min;
+        }
+        return result;
+    }
+
+    PostProcessRow<OC0> table[oc1size];
+};
+
+#endif
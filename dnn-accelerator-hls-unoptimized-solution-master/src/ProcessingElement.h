@@ -13,6 +13,8 @@ public:
     void CCS_BLOCK(run)(IDTYPE &input_in,
                         ODTYPE &psum_in,
                         WDTYPE &weight,
+                        bool &int4,
+                        bool &skip,
                         IDTYPE &input_out,
                         ODTYPE &psum_out)
     {
@@ -20,7 +22,19 @@ public:
         // Perform the MAC operation and forward inputs
         // Your code starts here
         // -------------------------------
-        psum_out = input_in * weight + psum_in;
+        if (skip) {
+            // zero input, the MAC is gated and the psum passes through
+            psum_out = psum_in;
+        } else if (int4) {
+            // packed int4: two 4x4 MACs per cycle, one per nibble, see Params.PRECISION
+            ac_int<4, true> input_lo = input_in.template slc<4>(0);
+            ac_int<4, true> input_hi = input_in.template slc<4>(4);
+            ac_int<4, true> weight_lo = weight.template slc<4>(0);
+            ac_int<4, true> weight_hi = weight.template slc<4>(4);
+            psum_out = input_lo * weight_lo + input_hi * weight_hi + psum_in;
+        } else {
+            psum_out = input_in * weight + psum_in;
+        }
         input_out = input_in;
         // -------------------------------
         // Your code ends here
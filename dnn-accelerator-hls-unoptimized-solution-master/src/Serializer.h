@@ -1,43 +1,146 @@
 #ifndef SERIALIZER_H
 #define SERIALIZER_H
 
-template<typename DTYPE, typename DTYPE_SERIAL, int OC0, int accumbuffersize>
-class Serializer{
+// Collects the rows of one output tile into a bank of the ping-pong buffer
+template<typename DTYPE, int OC0, int accumbuffersize>
+class SerializerWriter{
 public:
-    Serializer(){}
+    SerializerWriter(){}
 
     #pragma hls_design interface
-    #pragma hls_pipeline_init_interval 1
     void CCS_BLOCK(run)(ac_channel<DTYPE> &inputChannel,
-                        ac_channel<DTYPE_SERIAL> &serialOutChannel,
+                        ac_channel<chanStruct<DTYPE, accumbuffersize> > &dout,
                         ac_channel<Params> &paramsIn)
         {
             #ifndef __SYNTHESIS__
-            while(inputChannel.available(1))
+            while(paramsIn.available(1))
             #endif
             {
                 Params params = paramsIn.read();
-                uint_16 tile_size = params.OX0 * params.OY0;
-                DTYPE_SERIAL buffer[accumbuffersize][OC0];
-
-                // #pragma hls_pipeline_init_interval 1
-                for(int i = 0; i < tile_size; i++){
-                    DTYPE input = inputChannel.read();
-                    #pragma hls_unroll yes
-                    for(int j = 0; j < OC0; j++){
-                        buffer[i][j] = input.value[j];
+                uint_32 num_tiles = params.OX1 * params.OY1 * params.OC1;
+
+                // pooled tiles have fewer rows, see Pooler.h
+                OutputTileCursor tile;
+                tile.reset();
+                for(uint_32 t = 0; t < num_tiles; t++){
+                    uint_16 tile_size = output_tile_rows(params, tile.oy1, tile.ox1);
+                    chanStruct<DTYPE, accumbuffersize> tmp;
+
+                    #pragma hls_pipeline_init_interval 1
+                    for(int i = 0; i < tile_size; i++){
+                        tmp.data[i] = inputChannel.read();
                     }
+                    dout.write(tmp);
+                    tile.advance(params);
                 }
+            }
+        }
+};
+
+// Drains one bank of the ping-pong buffer, lanes output words per beat
+template<typename DTYPE, int OC0, int accumbuffersize, int lanes>
+class SerializerReader{
+public:
+    SerializerReader(){}
+
+    #pragma hls_design interface
+    void CCS_BLOCK(run)(ac_channel<chanStruct<DTYPE, accumbuffersize> > &din,
+                        ac_channel<PackedInt<OUTPUT_PRECISION, lanes> > &serialOutChannel,
+                        ac_channel<Params> &paramsIn)
+        {
+            #ifndef __SYNTHESIS__
+            while(paramsIn.available(1))
+            #endif
+            {
+                Params params = paramsIn.read();
+                uint_32 num_tiles = params.OX1 * params.OY1 * params.OC1;
+
+                OutputTileCursor tile;
+                tile.reset();
+                for(uint_32 t = 0; t < num_tiles; t++){
+                    uint_16 tile_size = output_tile_rows(params, tile.oy1, tile.ox1);
+
+                    // raw outputs: OC0 words per row, lanes divides OC0
+                    // requantized outputs: OC0/4 words per row, each packing 4 int8 channels
+                    // like input_serial; a beat may then span several rows and the last beat
+                    // of a tile is zero padded
+                    const int packed_words = OC0 / 4;
+                    uint_32 num_beats = tile_size * (OC0 / lanes);
+                    if (params.REQUANTIZE) {
+                        num_beats = (tile_size * packed_words + lanes - 1) / lanes;
+                    }
+
+                    chanStruct<DTYPE, accumbuffersize> tmp = din.read();
 
-                // #pragma hls_pipeline_init_interval 1
-                for(int i = 0; i < tile_size; i++){
-                    for(int j = 0; j < OC0; j++){
-                        serialOutChannel.write(buffer[i][j]);
+                    #pragma hls_pipeline_init_interval 1
+                    for(uint_32 b = 0; b < num_beats; b++){
+                        PackedInt<OUTPUT_PRECISION, lanes> beat;
+                        #pragma hls_unroll yes
+                        for(int l = 0; l < lanes; l++){
+                            uint_32 w = b * lanes + l;
+                            ac_int<OUTPUT_PRECISION, true> word = 0;
+                            if (params.REQUANTIZE) {
+                                uint_32 row = w / packed_words;
+                                uint_32 col = (w % packed_words) * 4;
+                                if (row < tile_size) {
+                                    #pragma hls_unroll yes
+                                    for(int k = 0; k < 4; k++){
+                                        word.set_slc(k*INPUT_PRECISION, (ac_int<INPUT_PRECISION, true>) tmp.data[row].value[col+k]);
+                                    }
+                                }
+                            } else {
+                                word = tmp.data[w / OC0].value[w % OC0];
+                            }
+                            beat.value[l] = word;
+                        }
+                        serialOutChannel.write(beat);
                     }
+                    tile.advance(params);
                 }
             }
         }
-    };
+};
+
+/*
+ * Output serializer: tiles go through a ping-pong buffer so that the drain of
+ * tile N overlaps with the systolic array computing tile N+1, and leave lanes
+ * words per beat instead of one word per cycle.
+ */
+template<typename DTYPE, int OC0, int accumbuffersize, int lanes>
+class Serializer{
+public:
+    Serializer(){}
+
+    #pragma hls_design interface
+    void CCS_BLOCK(run)(ac_channel<DTYPE> &inputChannel,
+                        ac_channel<PackedInt<OUTPUT_PRECISION, lanes> > &serialOutChannel,
+                        ac_channel<Params> &paramsIn)
+        {
+            #ifndef __SYNTHESIS__
+            while(paramsIn.available(1))
+            #endif
+            {
+                // one params per layer, the writer and reader walk the layer's tiles themselves
+                // and size each one with OutputTileCursor / output_tile_rows()
+                Params params = paramsIn.read();
+
+                serializerWriterParams.write(params);
+                serializerReaderParams.write(params);
+
+                serializerWriter.run(inputChannel, mem, serializerWriterParams);
+                serializerReader.run(mem, serialOutChannel, serializerReaderParams);
+            }
+        }
+
+private:
+    ac_channel<chanStruct<DTYPE, accumbuffersize> > mem;
+
+    SerializerWriter<DTYPE, OC0, accumbuffersize> serializerWriter;
+    ac_channel<Params> serializerWriterParams;
+
+    SerializerReader<DTYPE, OC0, accumbuffersize, lanes> serializerReader;
+    ac_channel<Params> serializerReaderParams;
+};
 
 
 #endif
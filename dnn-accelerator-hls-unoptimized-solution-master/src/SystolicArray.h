@@ -5,6 +5,10 @@
 #include "conv.h"
 #include "Fifo.h"
 #include "SystolicArrayCore.h"
+#include "Winograd.h"
+#if SYSTOLIC_ARRAY_FUNCTIONAL && !defined(__SYNTHESIS__)
+#include "SystolicArrayFunctional.h"
+#endif
 
 // Include mc_scverify.h for CCS_* macros
 #include <mc_scverify.h>
@@ -29,12 +33,38 @@ void run(ac_channel<Params> &paramsIn,
         #endif
         {
         Params params = paramsIn.read();
+        // The spatial and kernel tile loops are swapped for LOOP_ORDER_WEIGHT_STATIONARY,
+        // the outer loop runs over kernel tiles and the inner loop over image tiles
+        uint_16 outer_bound = params.OX1 * params.OY1;
+        uint_16 inner_bound = params.OC1;
+        if (params.LOOP_ORDER == LOOP_ORDER_WEIGHT_STATIONARY) {
+            outer_bound = params.OC1;
+            inner_bound = params.OX1 * params.OY1;
+        }
+        // depthwise: the array reduces over fx and every channel tile only sees
+        // its own input channels, a tile has one window per fy
+        uint_16 ic1_bound = params.IC1;
+        uint_16 fx_bound = params.FX;
+        uint_16 fy_bound = params.FY;
+        if (params.CONV_MODE == CONV_MODE_DEPTHWISE) {
+            ic1_bound = 1;
+            fx_bound = 1;
+        }
+        // Winograd: one window per transformed position of a channel tile
+        if (params.CONV_MODE == CONV_MODE_WINOGRAD) {
+            fx_bound = WINOGRAD_TILE;
+            fy_bound = WINOGRAD_TILE;
+        }
+        // sparse: a window covers two channel tiles
+        if (params.SPARSE != 0) {
+            ic1_bound = params.IC1 / 2;
+        }
         #pragma hls_pipeline_init_interval 1
-        LABEL(xy_o) for (uint_16 p = 0; p < params.OX1 * params.OY1; ++p) { //loop over image tiles        
-            LABEL(OC2) for(uint_16 oc1 = 0; oc1 < params.OC1; ++oc1){ // loop over kernel tiles    
-                LABEL(co) for (uint_16 ic1 = 0; ic1 < params.IC1; ++ic1) { // loop over channel tile
-                    LABEL(winx) for (uint_16 fx = 0; fx < params.FX; ++fx) { // loop over filter window x
-                        LABEL(winy) for (uint_16 fy = 0; fy < params.FY; ++fy) { // loop over filter window y
+        LABEL(xy_o) for (uint_16 p = 0; p < outer_bound; ++p) { //loop over image tiles (kernel tiles if weight stationary)
+            LABEL(OC2) for(uint_16 oc1 = 0; oc1 < inner_bound; ++oc1){ // loop over kernel tiles (image tiles if weight stationary)
+                LABEL(co) for (uint_16 ic1 = 0; ic1 < ic1_bound; ++ic1) { // loop over channel tile
+                    LABEL(winx) for (uint_16 fx = 0; fx < fx_bound; ++fx) { // loop over filter window x
+                        LABEL(winy) for (uint_16 fy = 0; fy < fy_bound; ++fy) { // loop over filter window y
                                 LoopIndices loopIndices = {
                                     ic1, 
                                     fx, 
@@ -55,7 +85,8 @@ void run(ac_channel<Params> &paramsIn,
     }
 };
 
-template <typename IDTYPE, typename WDTYPE, typename ODTYPE, int OC0, int IC0>
+// One core: the Winograd input transform in front of the array, see Winograd.h
+template <typename IDTYPE, typename WDTYPE, typename ODTYPE, int OC0, int IC0, int accumbuffersize>
 class SystolicArrayWrapper
 {
 public:
@@ -64,18 +95,146 @@ public:
 #pragma hls_design interface
 #pragma hls_pipeline_init_interval 1
     void run(ac_channel<PackedInt<INPUT_PRECISION, IC0> > &input, 
-             ac_channel<PackedInt<WEIGHT_PRECISION, OC0> > &weight, 
+             ac_channel<PackedInt<INPUT_PRECISION, IC0> > &input_hi,
+             ac_channel<PackedInt<ARRAY_WEIGHT_PRECISION, OC0> > &weight, 
+             ac_channel<PackedInt<SPARSE_INDEX_PRECISION, OC0> > &weight_index,
              ac_channel<PackedInt<OUTPUT_PRECISION, OC0> > &output,
+             ac_channel<uint_32> &skippedOut,
              ac_channel<Params> &paramsIn)
     {
-        systolicArrayLooper.run(paramsIn, paramsChannel, loopIndicesChannel);
-        systolicArrayCore.run(input, weight, output, paramsChannel, loopIndicesChannel);
+        #ifndef __SYNTHESIS__
+        while (paramsIn.available(1))
+        #endif
+        {
+            Params params = paramsIn.read();
+            inputTransformParams.write(params);
+            looperParams.write(params);
+
+            inputTransform.run(input, transformedInput, inputTransformParams);
+            systolicArrayLooper.run(looperParams, paramsChannel, loopIndicesChannel);
+            systolicArrayCore.run(transformedInput, input_hi, weight, weight_index, output, skippedOut, paramsChannel, loopIndicesChannel);
+        }
     }
 private:
-    SystolicArrayCore<IDTYPE, WDTYPE, ODTYPE, OC0, IC0> systolicArrayCore;
+    WinogradInputTransform<IC0, accumbuffersize / WINOGRAD_POSITIONS> inputTransform;
+    ac_channel<Params> inputTransformParams;
+    ac_channel<PackedInt<ARRAY_INPUT_PRECISION, IC0> > transformedInput;
+    ac_channel<Params> looperParams;
+
+    #if SYSTOLIC_ARRAY_FUNCTIONAL && !defined(__SYNTHESIS__)
+    SystolicArrayFunctional<IDTYPE, WDTYPE, ODTYPE, OC0, IC0, accumbuffersize> systolicArrayCore;
+    #else
+    SystolicArrayCore<IDTYPE, WDTYPE, ODTYPE, OC0, IC0, accumbuffersize> systolicArrayCore;
+    #endif
     SystolicArrayLooper systolicArrayLooper;
     ac_channel<Params> paramsChannel;
     ac_channel<LoopIndices> loopIndicesChannel;
 };
 
+// Merges the output tiles of the cores back into the tile order of the layer, and
+// the skipped MAC counts of the cores into one per layer
+template <int OC0, int cores>
+class SystolicArrayMerger
+{
+public:
+    SystolicArrayMerger(){}
+
+#pragma hls_design interface
+    void CCS_BLOCK(run)(ac_channel<PackedInt<OUTPUT_PRECISION, OC0> > coreOutput[cores],
+                        ac_channel<uint_32> coreSkipped[cores],
+                        ac_channel<PackedInt<OUTPUT_PRECISION, OC0> > &output,
+                        ac_channel<uint_32> &skippedOut,
+                        ac_channel<Params> &paramsIn)
+    {
+        #ifndef __SYNTHESIS__
+        while (paramsIn.available(1))
+        #endif
+        {
+            Params params = paramsIn.read();
+            uint_32 num_tiles = params.OX1 * params.OY1 * params.OC1;
+            uint_16 tile_size = array_tile_rows(params);
+
+            OutputTileCursor tile;
+            tile.reset();
+            for (uint_32 t = 0; t < num_tiles; t++) {
+                uint_16 core = tile.oc1 % cores;
+                #pragma hls_pipeline_init_interval 1
+                for (uint_16 i = 0; i < tile_size; i++) {
+                    PackedInt<OUTPUT_PRECISION, OC0> row;
+                    #pragma hls_unroll yes
+                    for (int k = 0; k < cores; k++) {
+                        if (core == k) {
+                            row = coreOutput[k].read();
+                        }
+                    }
+                    output.write(row);
+                }
+                tile.advance(params);
+            }
+
+            // only the cores with kernel tiles in the layer report a count
+            uint_32 skipped = 0;
+            #pragma hls_unroll yes
+            for (int k = 0; k < cores; k++) {
+                if (k < params.OC1) {
+                    skipped += coreSkipped[k].read();
+                }
+            }
+            skippedOut.write(skipped);
+        }
+    }
+};
+
+/*
+ * cores systolic arrays side by side, kernel tile oc1 runs on core oc1 % cores with
+ * the inputs and weights of that core, see Multi-core in conv.h. Every core runs its
+ * kernel tiles of the layer as a layer of its own.
+ */
+template <typename IDTYPE, typename WDTYPE, typename ODTYPE, int OC0, int IC0, int cores, int accumbuffersize>
+class SystolicArrayCluster
+{
+public:
+    SystolicArrayCluster(){}
+
+#pragma hls_design interface
+    void CCS_BLOCK(run)(ac_channel<PackedInt<INPUT_PRECISION, IC0> > input[cores],
+                        ac_channel<PackedInt<INPUT_PRECISION, IC0> > input_hi[cores],
+                        ac_channel<PackedInt<ARRAY_WEIGHT_PRECISION, OC0> > weight[cores],
+                        ac_channel<PackedInt<SPARSE_INDEX_PRECISION, OC0> > weight_index[cores],
+                        ac_channel<PackedInt<OUTPUT_PRECISION, OC0> > &output,
+                        ac_channel<uint_32> &skippedOut,
+                        ac_channel<Params> &paramsIn)
+    {
+        #ifndef __SYNTHESIS__
+        while (paramsIn.available(1))
+        #endif
+        {
+            Params params = paramsIn.read();
+
+            // a core without kernel tiles in the layer sits it out
+            #pragma hls_unroll yes
+            for (int k = 0; k < cores; k++) {
+                if (k < params.OC1) {
+                    coreParams[k].write(core_params(params, k, cores));
+                }
+            }
+            mergerParams.write(params);
+
+            #pragma hls_unroll yes
+            for (int k = 0; k < cores; k++) {
+                systolicArray[k].run(input[k], input_hi[k], weight[k], weight_index[k], coreOutput[k], coreSkipped[k], coreParams[k]);
+            }
+            merger.run(coreOutput, coreSkipped, output, skippedOut, mergerParams);
+        }
+    }
+private:
+    SystolicArrayWrapper<IDTYPE, WDTYPE, ODTYPE, OC0, IC0, accumbuffersize> systolicArray[cores];
+    ac_channel<Params> coreParams[cores];
+    ac_channel<PackedInt<OUTPUT_PRECISION, OC0> > coreOutput[cores];
+    ac_channel<uint_32> coreSkipped[cores];
+
+    SystolicArrayMerger<OC0, cores> merger;
+    ac_channel<Params> mergerParams;
+};
+
 #endif
@@ -26,174 +26,427 @@
 
 // Only works for square arrays
 template <typename T>
-
-        // Read in the params and loop indices from the channel
-        Params params = paramsIn.read();
-        LoopIndices loopIndices = loopIndicesIn.read();
-
-        // Flattened loop for IC1, FY, FX, OY0, OX0
-        int IC1 = params.IC1;
-        int FY  = params.FY;
-        int FX  = params.FX;
-        int OY0 = params.OY0;
-        int OX0 = params.OX0;
-        int total_iters = IC1 * FY * FX * OY0 * OX0 + IC0 + OC0 - 1;
-
-        #pragma hls_pipeline_init_interval 1
-        for (int flat_idx = 0; flat_idx < total_iters; ++flat_idx) {
-            // Calculate each index from the flat index
-            int ic1_idx = (flat_idx / (FY * FX * OY0 * OX0)) % IC1;
-            int fy_idx  = (flat_idx / (FX * OY0 * OX0)) % FY;
-            int fx_idx  = (flat_idx / (OY0 * OX0)) % FX;
-            int oy0_idx = (flat_idx / OX0) % OY0;
-            int ox0_idx = flat_idx % OX0;
-#ifndef __SYNTHESIS__
-            if (flat_idx < 10) {
-                std::cout << "flat_idx=" << flat_idx
-                          << " ic1_idx=" << ic1_idx
-                          << " fy_idx=" << fy_idx
-                          << " fx_idx=" << fx_idx
-                          << " oy0_idx=" << oy0_idx
-                          << " ox0_idx=" << ox0_idx << std::endl;
-            }
+void log_matrix(std::ofstream &file, T &matrix, int step, int dim) {
+    file << "step " << step << "\n";
+    for (int i = 0; i < dim; i++) {
+        for (int j = 0; j < dim; j++) {
+            file << matrix[i][j] << " ";
+        }
+        file << "\n";
+    }
+    file << "\n";
+}
+
+// input_reg holds the inputs of a row group
+template <size_t width, size_t EXTENT_0>
+std::ostream &operator<<(std::ostream &os, PackedInt<width, EXTENT_0> &value) {
+    return os << value.to_string();
+}
+
+std::ofstream input_file("input_reg.log");
+std::ofstream weight_file("weight_reg.log");
+std::ofstream psum_file("psum_reg.log");
+#endif
 #endif
 
-            // Example: Use these indices for your computation
-            // You may need to update the logic below to use these indices
+struct LoopIndices{
+    uint_16 ic1_idx;
+    uint_16 fx_idx;
+    uint_16 fy_idx;
+};
 
-            // Read weights if needed (e.g., at the start of a tile)
-            if (flat_idx < IC0) {
-                PackedInt<WEIGHT_PRECISION, OC0> w_row = weight.read();
-                #pragma hls_unroll yes
-                for(int j = 0; j < OC0; j++){
-                    weight_reg[flat_idx][j] = w_row.value[j];
-                }
-#ifndef __SYNTHESIS__
-                if (flat_idx < 10) {
-                    std::cout << "Weight: ";
-                    for (int j = 0; j < OC0; ++j) std::cout << int(weight_reg[flat_idx][j]) << " ";
-                    std::cout << std::endl;
-                }
-#endif
+// Accumulation buffer row of the pixels of a window, in the order they are streamed.
+// A dense window streams one pixel per output. A depthwise window streams whole
+// input rows, and only every STRIDE-th of the first (OX0-1)*STRIDE+1 positions of a
+// row is an output.
+struct AccumulationCursor{
+    uint_16 x;      // position in the input row
+    uint_16 ox0;    // next output of the row
+    uint_16 row;    // accumulation buffer row of the next output
+
+    void reset() {
+        x = 0;
+        ox0 = 0;
+        row = 0;
+    }
+
+    // whether the current pixel is an output, stored at row
+    bool output(const Params &params) {
+        return params.CONV_MODE != CONV_MODE_DEPTHWISE || (x == ox0 * params.STRIDE && ox0 < params.OX0);
+    }
+
+    void advance(const Params &params, uint_16 ix0) {
+        bool out = output(params);
+        if (out) {
+            row++;
+        }
+        if (params.CONV_MODE == CONV_MODE_DEPTHWISE) {
+            if (out) {
+                ox0++;
+            }
+            if (x == ix0 - 1) {
+                x = 0;
+                ox0 = 0;
+            } else {
+                x++;
             }
+        }
+    }
+};
 
-            PackedInt<INPUT_PRECISION, IC0> in_col;
-            if (flat_idx < (OX0 * OY0)) {
-                in_col = input.read();
-#ifndef __SYNTHESIS__
-                if (flat_idx < 10) {
-                    std::cout << "Input: ";
-                    for (int i = 0; i < IC0; ++i) std::cout << int(in_col.value[i]) << " ";
-                    std::cout << std::endl;
-                }
-#endif
+
+template <typename IDTYPE, typename WDTYPE, typename ODTYPE, int OC0, int IC0, int accumbuffersize>
+class SystolicArrayCore
+{
+public:
+    SystolicArrayCore() : layer_runs(0), skipped_macs(0)
+    {
+        // the bank, zero and index registers drive the PEs before the first window
+        // reaches them, so they start cleared
+        for (int i = 0; i < IC0; i++) {
+            bank_skew[i] = false;
+            for (int j = 0; j < OC0; j++) {
+                bank_reg[i][j] = false;
+                zero_reg[i][j] = false;
+                weight_index_reg[0][i][j] = 0;
+                weight_index_reg[1][i][j] = 0;
             }
+        }
+    }
 
-            PackedInt<INPUT_PRECISION, IC0> input_buf;
-            #define INPUT_FIFO_BODY(z,i,unused) \
-                IDTYPE BOOST_PP_CAT(input_fifo_output_, i); \
-                IDTYPE BOOST_PP_CAT(input_fifo_input_, i) = in_col.value[i]; \
-                BOOST_PP_CAT(input_fifo_, i).run( BOOST_PP_CAT(input_fifo_input_, i) , BOOST_PP_CAT(input_fifo_output_, i) ); \
-                input_buf.value[i] = BOOST_PP_CAT(input_fifo_output_, i);
-            REPEAT(INPUT_FIFO_BODY)
-
-            #pragma hls_unroll yes
-            LABEL(INIT_IN) for(int i = 0; i < IC0; ++i) {
-                input_reg[i][0] = input_buf.value[i];
+#pragma hls_design interface
+#pragma hls_pipeline_init_interval 1
+    void CCS_BLOCK(run)(
+        ac_channel<PackedInt<ARRAY_INPUT_PRECISION, IC0> > &input, 
+        ac_channel<PackedInt<INPUT_PRECISION, IC0> > &input_hi,
+        ac_channel<PackedInt<ARRAY_WEIGHT_PRECISION, OC0> > &weight, 
+        ac_channel<PackedInt<SPARSE_INDEX_PRECISION, OC0> > &weight_index,
+        ac_channel<PackedInt<OUTPUT_PRECISION, OC0> > &output,
+        ac_channel<uint_32> &skippedOut,
+        ac_channel<Params> &paramsIn,
+        ac_channel<LoopIndices> &loopIndicesIn)
+    {
+        #ifndef __SYNTHESIS__
+        while(paramsIn.available(1))
+        #endif
+        {
+            // -------------------------------
+            // Read in the params from the channel
+            // One run of the array covers all IC1*FY*FX windows of an output tile (of
+            // every tile of the layer in GEMM mode), the params and loop indices of
+            // each window are read when it starts
+            // Your code starts here
+            // -------------------------------
+            Params params = paramsIn.read();
+            // -------------------------------
+            // Your code ends here
+            // -------------------------------
+
+            // -------------------------------
+            // Create a loop for a "run" of the systolic array.
+            // A new window enters the array every window_period steps. Without
+            // CONTINUOUS_STREAMING a window only starts once the previous one has
+            // drained (ramp-up time + number of pixels + flush time). With it, the
+            // next window is fed into the skew FIFOs while the previous one drains,
+            // limited by the accumulation_buffer: a pixel's psum has to come out of
+            // the array before the next window reads it back (IC0+OC0 steps).
+            // Consecutive windows use alternating weight_reg banks, so loading the
+            // next window's weights never stalls the array.
+            // Your code starts here
+            // -------------------------------
+            // the pixels of all images in the batch share the window's weights
+            uint_16 tile_size = window_pixels(params);
+            uint_32 num_windows = params.IC1 * params.FX * params.FY;
+            // depthwise: a window is one filter row fy, the input lane j is broadcast
+            // down column j and every input row of the tile is streamed in full
+            bool depthwise = (params.CONV_MODE == CONV_MODE_DEPTHWISE);
+            bool int4 = (params.PRECISION == PRECISION_INT4);
+            // sparse: a window covers channel tiles 2*ic1 and 2*ic1+1, see Params.SPARSE
+            bool sparse = (params.SPARSE != 0);
+            uint_16 ix0 = (params.OX0 - 1) * params.STRIDE + params.FX;
+            uint_16 ic1_bound = params.IC1;
+            uint_16 fx_bound = params.FX;
+            uint_16 fy_bound = params.FY;
+            // Winograd: a window per transformed position of a channel tile, each one
+            // over the patches of the tile and with accumulation buffer rows of its own
+            bool winograd = (params.CONV_MODE == CONV_MODE_WINOGRAD);
+            if (winograd) {
+                fx_bound = WINOGRAD_TILE;
+                fy_bound = WINOGRAD_TILE;
+                num_windows = params.IC1 * WINOGRAD_POSITIONS;
+            }
+            if (sparse) {
+                ic1_bound = params.IC1 / 2;
+                num_windows = ic1_bound * params.FX * params.FY;
             }
+            if (depthwise) {
+                tile_size = params.N * params.OY0 * ix0;
+                num_windows = params.FY;
+                ic1_bound = 1;
+                fx_bound = 1;
+            }
+            // GEMM: one run covers the windows of all tiles of the layer, so the array
+            // only fills and drains once per layer
+            // array runs of the layer, one per output tile
+            uint_32 layer_run_count = params.OX1 * params.OY1 * params.OC1;
+            if (params.CONV_MODE == CONV_MODE_GEMM) {
+                num_windows = ic1_bound * params.OX1 * params.OY1 * params.OC1;
+                layer_run_count = 1;
+            }
+            #if CONTINUOUS_STREAMING
+            uint_16 window_period = tile_size;
+            if (window_period < IC0 + OC0) {
+                window_period = IC0 + OC0;
+            }
+            #else
+            uint_16 window_period = tile_size + IC0 + OC0 - 1;
+            #endif
+            uint_32 step_bound = (num_windows - 1) * window_period + tile_size + IC0 + OC0 - 1;
+
+            // Position of the window entering the array, and of the window draining out of it
+            uint_32 in_window = 0;
+            uint_16 in_pos = 0;
+            uint_32 out_window = 0;
+            uint_16 out_pos = 0;
+            AccumulationCursor in_cursor;
+            AccumulationCursor out_cursor;
+            in_cursor.reset();
+            out_cursor.reset();
+            // At most two windows are in flight, indexed by the parity of the window number
+            bool window_last[2];
+            // first accumulation buffer row of a window, window k of a Winograd channel
+            // tile accumulates transformed position k into rows [k*tile_size, (k+1)*tile_size)
+            uint_16 window_base[2];
+            bool window_first;
+
+            LoopIndices loopIndices;
+            #pragma hls_pipeline_init_interval 1
+            LABEL(INNER_LOOP) for (uint_32 step = 0; ; ++step) {
+            // -------------------------------
+            // Your code ends here 
+            // You should now be in the body of the loop
+            // -------------------------------
+
+                bool in_valid = (in_window < num_windows) && (in_pos < tile_size);
+
+                // -------------------------------
+                // Read the params and loop indices at the start of every window
+                // Your code starts here
+                // -------------------------------
+                if (in_window < num_windows && in_pos == 0) {
+                    if (in_window != 0) {
+                        params = paramsIn.read();
+                    }
+                    loopIndices = loopIndicesIn.read();
+                    // the windows of a Winograd channel tile accumulate on their own
+                    window_first = (loopIndices.ic1_idx == 0 &&
+                                    (winograd || (loopIndices.fx_idx == 0 && loopIndices.fy_idx == 0)));
+                    window_last[in_window & 1] = (loopIndices.ic1_idx == ic1_bound-1 &&
+                                                  (winograd || (loopIndices.fx_idx == fx_bound-1 &&
+                                                                loopIndices.fy_idx == fy_bound-1)));
+                    window_base[in_window & 1] = 0;
+                    if (winograd) {
+                        window_base[in_window & 1] = (loopIndices.fx_idx * fy_bound + loopIndices.fy_idx) * tile_size;
+                    }
+                    in_cursor.row = window_base[in_window & 1];
+                }
+                // -------------------------------
+                // Your code ends here
+                // -------------------------------
 
-            PackedInt<OUTPUT_PRECISION, OC0> psum_buf;
-            if(flat_idx < (OX0 * OY0)){
-                if(ic1_idx == 0 && fx_idx == 0 && fy_idx == 0) {
+                // -------------------------------
+                // If you are in the ramp up time of a window, read in weights from the channel
+                // and store it in the window's weight bank. Row i is written just before the
+                // window's first pixel reaches it, while the other bank is still in use by
+                // the previous window further down the skew
+                // Your code starts here
+                // -------------------------------
+                if (in_window < num_windows && in_pos < IC0) {
+                    PackedInt<ARRAY_WEIGHT_PRECISION, OC0> w_row = weight.read();
+                    PackedInt<SPARSE_INDEX_PRECISION, OC0> w_index;
+                    if (sparse) {
+                        w_index = weight_index.read();
+                    }
                     #pragma hls_unroll yes
                     for(int j = 0; j < OC0; j++){
-                        psum_buf.value[j].template set_val<AC_VAL_0>();
+                        weight_reg[in_window & 1][in_pos][j] = w_row.value[j];
+                        // dense: every PE takes the first input of its row
+                        weight_index_reg[in_window & 1][in_pos][j] = 0;
+                        if (sparse) {
+                            weight_index_reg[in_window & 1][in_pos][j] = w_index.value[j];
+                        }
                     }
                 }
-                else{
+                // -------------------------------
+                // Your code ends here
+                // -------------------------------
+
+                PackedInt<ARRAY_INPUT_PRECISION, IC0> in_col;
+                PackedInt<INPUT_PRECISION, IC0> in_col_hi;
+
+                // -------------------------------
+                // Read inputs from the channel and store in the variable in_col
+                // Note: you don't read in any inputs during the flush time
+                // Your code starts here
+                // -------------------------------
+                if (in_valid) {
+                    in_col = input.read();
+                    if (sparse) {
+                        in_col_hi = input_hi.read();
+                    }
+                }
+                // -------------------------------
+                // Your code ends here
+                // -------------------------------
+
+                // Inputs of every row: sparse, the 4 channels of group i/2 of the 2*IC0
+                // channels in in_col, in_col_hi; dense, channel i in the first entry
+                PackedInt<ARRAY_INPUT_PRECISION, ARRAY_INPUT_GROUP> in_group[IC0];
+                #pragma hls_unroll yes
+                for(int i = 0; i < IC0; i++) {
                     #pragma hls_unroll yes
-                    for(int j = 0; j < OC0; j++){
-                        psum_buf.value[j] = accumulation_buffer[flat_idx][j];
+                    for(int k = 0; k < ARRAY_INPUT_GROUP; k++) {
+                        int c = SPARSE_GROUP * (i / 2) + k;
+                        if (sparse) {
+                            if (c < IC0) {
+                                in_group[i].value[k] = in_col.value[c % IC0];
+                            } else {
+                                in_group[i].value[k] = in_col_hi.value[c % IC0];
+                            }
+                        } else {
+                            in_group[i].value[k] = 0;
+                            if (k == 0) {
+                                in_group[i].value[k] = in_col.value[i];
+                            }
+                        }
                     }
-#ifndef __SYNTHESIS__
-                    if (flat_idx < 10) {
-                        std::cout << "AccumBuf before: ";
-                        for (int j = 0; j < OC0; ++j) std::cout << int(accumulation_buffer[flat_idx][j]) << " ";
-                        std::cout << std::endl;
+                }
+
+                // Rows whose inputs are all zero skip their OC0 MACs, counted as the
+                // pixel enters the array
+                if (in_valid && !depthwise) {
+                    ac_int<ac::log2_ceil<IC0+1>::val, false> zero_rows = 0;
+                    #pragma hls_unroll yes
+                    for(int i = 0; i < IC0; i++) {
+                        if (all_zero(in_group[i])) {
+                            zero_rows++;
+                        }
                     }
-#endif
+                    skipped_macs += zero_rows * OC0;
                 }
-            }
 
-            PackedInt<OUTPUT_PRECISION, OC0> output_buf;
-            #define ACCUM_FIFO_BODY(z,i,unused) \
-                ODTYPE BOOST_PP_CAT(psum_fifo_output_, i); \
-                ODTYPE BOOST_PP_CAT(psum_fifo_input_, i) = psum_buf.value[i]; \
-                BOOST_PP_CAT(psum_fifo_, i).run( BOOST_PP_CAT(psum_fifo_input_, i) , BOOST_PP_CAT(psum_fifo_output_, i) ); \
-                output_buf.value[i] = BOOST_PP_CAT(psum_fifo_output_, i);
-            REPEAT(ACCUM_FIFO_BODY)
-
-            #pragma hls_unroll yes
-            LABEL(INIT_OUT) for(int j = 0; j < OC0; ++j) {
-                psum_reg[0][j] = output_buf.value[j];
-            }
+                /*
+                 * FIFOs for inputs coming in to the systolic array
+                 * assign values to in_group, and the skewed version will be in input_buf
+                 */
+                PackedInt<ARRAY_INPUT_PRECISION, ARRAY_INPUT_GROUP> input_buf[IC0];
 
-            #pragma hls_unroll yes
-            LABEL(COL) for (int j=0; j < OC0; ++j) {
+                #define INPUT_FIFO_BODY(z,i,unused) \
+                    PackedInt<ARRAY_INPUT_PRECISION, ARRAY_INPUT_GROUP> BOOST_PP_CAT(input_fifo_output_, i); \
+                    BOOST_PP_CAT(input_fifo_, i).run( in_group[i] , BOOST_PP_CAT(input_fifo_output_, i) ); \
+                    input_buf[i] = BOOST_PP_CAT(input_fifo_output_, i);
+                
+                REPEAT_IC0(INPUT_FIFO_BODY)
+
+                // -------------------------------
+                // Assign values from input_buf into the registers for the first column of PEs
+                // Your code starts here
+                // -------------------------------
                 #pragma hls_unroll yes
-                LABEL(ROW) for (int i=0; i < IC0; ++i) {
-                    pe[i][j].run(input_reg[i][j], psum_reg[i][j], weight_reg[i][j], input_reg2[i][j], psum_reg2[i][j]);
+                LABEL(INIT_IN) for(int i = 0; i < IC0; ++i) {
+                    input_reg[i][0] = input_buf[i];
+                    zero_reg[i][0] = !depthwise && all_zero(input_buf[i]);
                 }
-            }
 
-            PackedInt<OUTPUT_PRECISION, OC0> output_row;
-            #define FIFO_WRITE_BODY_NEW(z,i,unused)\
-                ODTYPE BOOST_PP_CAT(accum_fifo_output_, i); \
-                BOOST_PP_CAT(accum_fifo_, i).run( psum_reg[IC0][i] , BOOST_PP_CAT(accum_fifo_output_, i) );\
-                output_row.value[i] = BOOST_PP_CAT(accum_fifo_output_,i); \
-            REPEAT(FIFO_WRITE_BODY_NEW)
-
-            if(flat_idx >= OC0+IC0-1){
+                // The weight bank travels with the inputs: skewed like input_buf, then
+                // shifted along each row with input_reg
                 #pragma hls_unroll yes
-                for(int i = 0; i < OC0; i++){
-                    accumulation_buffer[flat_idx-(IC0+OC0-1)][i] = output_row.value[i];
+                for(int i = IC0-1; i > 0; i--) {
+                    bank_skew[i] = bank_skew[i-1];
                 }
-#ifndef __SYNTHESIS__
-                if (flat_idx < 10) {
-                    std::cout << "AccumBuf after: ";
-                    for (int j = 0; j < OC0; ++j) std::cout << int(accumulation_buffer[flat_idx-(IC0+OC0-1)][j]) << " ";
-                    std::cout << std::endl;
+                bank_skew[0] = in_window & 1;
+                #pragma hls_unroll yes
+                for(int i = 0; i < IC0; ++i) {
+                    bank_reg[i][0] = bank_skew[i];
                 }
-#endif
-                if (ic1_idx == IC1-1 && fx_idx == FX-1 && fy_idx == FY-1) {   
-                    output.write(output_row);
-#ifndef __SYNTHESIS__
-                    std::cout << "Output written at flat_idx=" << flat_idx << ": ";
-                    for (int j = 0; j < OC0; ++j) std::cout << int(output_row.value[j]) << " ";
-                    std::cout << std::endl;
-#endif
+                // -------------------------------
+                // Your code ends here
+                // -------------------------------
+
+                PackedInt<OUTPUT_PRECISION, OC0> psum_buf;
+                
+                // -------------------------------
+                // Set partial outputs for the array to psum_buf.
+                // Depending on the loop index, the partial output will be 0 or a value from the accumulation buffer
+                // Your code starts here
+                // -------------------------------
+                if (in_valid) {
+                    if (window_first || !in_cursor.output(params)) {
+                        #pragma hls_unroll yes
+                        for(int j = 0; j < OC0; j++){
+                            psum_buf.value[j].template set_val<AC_VAL_0>();
+                        }
+                    } else {
+                        #pragma hls_unroll yes
+                        for(int j = 0; j < OC0; j++){
+                            psum_buf.value[j] = accumulation_buffer[in_cursor.row][j];
+                        }
+                    }
                 }
-            }
+                // -------------------------------
+                // Your code ends here
+                // -------------------------------
+
+                /*
+                 * FIFOs for partial outputs coming in to the systolic array
+                 * assign values to psum_buf, and the skewed version will be in output_buf
+                 */
+                PackedInt<OUTPUT_PRECISION, OC0> output_buf;
 
-            #pragma hls_unroll yes
-            for(int j = 0; j < OC0; j++){
+                #define ACCUM_FIFO_BODY(z,i,unused) \
+                    ODTYPE BOOST_PP_CAT(psum_fifo_output_, i); \
+                    ODTYPE BOOST_PP_CAT(psum_fifo_input_, i) = psum_buf.value[i]; \
+                    BOOST_PP_CAT(psum_fifo_, i).run( BOOST_PP_CAT(psum_fifo_input_, i) , BOOST_PP_CAT(psum_fifo_output_, i) ); \
+                    output_buf.value[i] = BOOST_PP_CAT(psum_fifo_output_, i);
+                
+                REPEAT_OC0(ACCUM_FIFO_BODY)
+        
+                // -------------------------------
+                // Assign values from output_buf into the partial sum registers for the first row of PEs
+                // Your code starts here
+                // -------------------------------
                 #pragma hls_unroll yes
-                for(int i = 0; i < IC0; i++){
-                    input_reg[i][j+1] = input_reg2[i][j];
-                    psum_reg[i+1][j] = psum_reg2[i][j];
+                LABEL(INIT_OUT) for(int j = 0; j < OC0; ++j) {
+                    psum_reg[0][j] = output_buf.value[j];
                 }
-            }
-        }
-        // Debug example:
-        // printf("outputs written: %d\n", output.size());
-    }
+                // -------------------------------
+                // Your code ends here
+                // -------------------------------
+
+                // -------------------------------
+                // Run the 16x16 PEs in the array. 
                 // Your code starts here
                 // -------------------------------
                 #pragma hls_unroll yes
                 LABEL(COL) for (int j=0; j < OC0; ++j) {
                     #pragma hls_unroll yes
                     LABEL(ROW) for (int i=0; i < IC0; ++i) {
-                        pe[i][j].run(input_reg[i][j], psum_reg[i][j], weight_reg[i][j], input_reg2[i][j], psum_reg2[i][j]);
+                        // the mux in front of the PE selects the input of the weight's index
+                        bool bank = bank_reg[i][j];
+                        #if SPARSE_ARRAY
+                        IDTYPE pe_input = input_reg[i][j].value[weight_index_reg[bank][i][j]];
+                        #else
+                        IDTYPE pe_input = input_reg[i][j].value[0];
+                        #endif
+                        // depthwise: the skewed input lane j reaches all rows of column j at
+                        // once, so row i sees the pixel i positions after the psum's pixel
+                        if (depthwise && j < IC0) {
+                            pe_input = input_buf[j].value[0];
+                        }
+                        IDTYPE pe_input_out;
+                        pe[i][j].run(pe_input, psum_reg[i][j], weight_reg[bank][i][j], int4, zero_reg[i][j], pe_input_out, psum_reg2[i][j]);
+                        // all inputs of the row move on to the next PE
+                        input_reg2[i][j] = input_reg[i][j];
                     } //ROW
                 } //COL
                 // -------------------------------
@@ -204,7 +457,7 @@ template <typename T>
                 #if HLS_DEBUG
                 #ifndef __SYNTHESIS__
                 log_matrix(input_file, input_reg, step, OC0);
-                log_matrix(weight_file, weight_reg, step, OC0);
+                log_matrix(weight_file, weight_reg[in_window & 1], step, OC0);
                 log_matrix(psum_file, psum_reg, step, OC0);
                 #endif
                 #endif
@@ -221,19 +474,20 @@ template <typename T>
                     BOOST_PP_CAT(accum_fifo_, i).run( psum_reg[IC0][i] , BOOST_PP_CAT(accum_fifo_output_, i) );\
                     output_row.value[i] = BOOST_PP_CAT(accum_fifo_output_,i); \
                 
-                REPEAT(FIFO_WRITE_BODY_NEW)
+                REPEAT_OC0(FIFO_WRITE_BODY_NEW)
 
                 // -------------------------------
                 // After a certain number of cycles, you will have valid output from the systolic array
                 // Depending on the loop indices, this valid output will either be written into the accumulation buffer or written out
+                // The accumulation buffer address follows the skew, lagging the input by IC0+OC0-1 steps
                 // Your code starts here
                 // -------------------------------
-                if(step >= OC0+IC0-1){
+                if(step >= OC0+IC0-1 && out_pos < tile_size && out_cursor.output(params)){
                     #pragma hls_unroll yes
                     for(int i = 0; i < OC0; i++){
-                        accumulation_buffer[step-(IC0+OC0-1)][i] = output_row.value[i];
+                        accumulation_buffer[out_cursor.row][i] = output_row.value[i];
                     }
-                    if (loopIndices.ic1_idx==params.IC1-1 && loopIndices.fx_idx == params.FX-1 && loopIndices.fy_idx == params.FY-1) {   
+                    if (window_last[out_window & 1]) {
                         output.write(output_row);
                     }
                 }
@@ -254,12 +508,53 @@ template <typename T>
                         psum_reg[i+1][j] = psum_reg2[i][j];
                     }
                 }
+                #pragma hls_unroll yes
+                for(int j = OC0-1; j > 0; j--){
+                    #pragma hls_unroll yes
+                    for(int i = 0; i < IC0; i++){
+                        bank_reg[i][j] = bank_reg[i][j-1];
+                        zero_reg[i][j] = zero_reg[i][j-1];
+                    }
+                }
 
                 // -------------------------------
                 // Your code ends here
                 // -------------------------------
+
+                // Advance the window positions
+                if (in_valid) {
+                    in_cursor.advance(params, ix0);
+                }
+                if (in_pos == window_period - 1) {
+                    in_pos = 0;
+                    in_window++;
+                    in_cursor.reset();
+                } else {
+                    in_pos++;
+                }
+                if (step >= OC0+IC0-1) {
+                    if (out_pos < tile_size) {
+                        out_cursor.advance(params, ix0);
+                    }
+                    if (out_pos == window_period - 1) {
+                        out_pos = 0;
+                        out_window++;
+                        out_cursor.reset();
+                        out_cursor.row = window_base[out_window & 1];
+                    } else {
+                        out_pos++;
+                    }
+                }
+
                 if (step == step_bound-1) break;
             }
+
+            // one count per layer, after the run of its last output tile
+            if (++layer_runs == layer_run_count) {
+                skippedOut.write(skipped_macs);
+                skipped_macs = 0;
+                layer_runs = 0;
+            }
         }
     
         // Debug example:
@@ -267,7 +562,19 @@ template <typename T>
     }
 
 private:
-    
+    // whether all inputs of a row are zero
+    static bool all_zero(PackedInt<ARRAY_INPUT_PRECISION, ARRAY_INPUT_GROUP> &inputs)
+    {
+        bool zero = true;
+        #pragma hls_unroll yes
+        for (int k = 0; k < ARRAY_INPUT_GROUP; k++) {
+            if (inputs.value[k] != 0) {
+                zero = false;
+            }
+        }
+        return zero;
+    }
+
     // -------------------------------
     // Create the following:
     //  - PE array
@@ -279,10 +586,20 @@ private:
     // -------------------------------
     ProcessingElement<IDTYPE, WDTYPE, ODTYPE> pe[IC0][OC0];
 
-    ODTYPE accumulation_buffer[ACCUMULATION_BUFFER_SIZE][OC0];
-    WDTYPE weight_reg[IC0][OC0];
-    IDTYPE input_reg[IC0][OC0+1];
-    IDTYPE input_reg2[IC0][OC0];
+    ODTYPE accumulation_buffer[accumbuffersize][OC0];
+    // Two weight banks, window n uses bank n%2 while the other one is loaded
+    WDTYPE weight_reg[2][IC0][OC0];
+    // input of its row group that every weight multiplies, see Params.SPARSE
+    ac_int<SPARSE_INDEX_PRECISION, false> weight_index_reg[2][IC0][OC0];
+    bool bank_reg[IC0][OC0];
+    bool bank_skew[IC0];
+    // the row's inputs of the pixel in the PE are zero, shifted along with input_reg
+    bool zero_reg[IC0][OC0];
+    // skipped MACs of the current layer, see zero activation gating in conv.h
+    uint_32 layer_runs;
+    uint_32 skipped_macs;
+    PackedInt<ARRAY_INPUT_PRECISION, ARRAY_INPUT_GROUP> input_reg[IC0][OC0+1];
+    PackedInt<ARRAY_INPUT_PRECISION, ARRAY_INPUT_GROUP> input_reg2[IC0][OC0];
     ODTYPE psum_reg[IC0+1][OC0];
     ODTYPE psum_reg2[IC0][OC0];
     // -------------------------------
@@ -291,20 +608,20 @@ private:
     
 
 #define INPUT_FIFOS_INIT(z, i, unused) \
-    Fifo<IDTYPE, i + 1> BOOST_PP_CAT(input_fifo_, i);
+    Fifo<PackedInt<ARRAY_INPUT_PRECISION, ARRAY_INPUT_GROUP>, i + 1> BOOST_PP_CAT(input_fifo_, i);
 
-    REPEAT(INPUT_FIFOS_INIT)
+    REPEAT_IC0(INPUT_FIFOS_INIT)
 
 #define ACCUM_FIFOS_INIT(z, i, unused) \
     Fifo<ODTYPE, i + 1> BOOST_PP_CAT(psum_fifo_, i);
 
-    REPEAT(ACCUM_FIFOS_INIT)
+    REPEAT_OC0(ACCUM_FIFOS_INIT)
     
 
 #define OUTPUT_FIFOS_INIT(z, i, unused) \
     Fifo<ODTYPE, OC0 - i> BOOST_PP_CAT(accum_fifo_, i);
     
-    REPEAT(OUTPUT_FIFOS_INIT)
+    REPEAT_OC0(OUTPUT_FIFOS_INIT)
 };
 
 #endif
@@ -0,0 +1,283 @@
+#ifndef SYSTOLIC_ARRAY_FUNCTIONAL_H
+#define SYSTOLIC_ARRAY_FUNCTIONAL_H
+
+/*
+ * Functional model of SystolicArrayCore for C simulation only.
+ * It has the same channel interface and gives bit-identical outputs, but every
+ * (ic1, fx, fy) window is computed as an OX0*OY0 x IC0 x OC0 int8 GEMM (2*IC0 int4
+ * channels with Params.PRECISION INT4, 2*IC0 int8 channels with the 2:4 weights of
+ * Params.SPARSE expanded, a transformed position of the patches with Winograd) on
+ * native integers instead of stepping the PEs and skew FIFOs cycle by cycle.
+ * Input pairs that are zero are left out of the GEMM, and the MACs the array gates
+ * for zero rows are counted the same way.
+ * Selected with SYSTOLIC_ARRAY_FUNCTIONAL, see SystolicArray.h.
+ */
+
+#include <stdint.h>
+#include <vector>
+#if defined(__AVX512F__) && defined(__AVX512VNNI__)
+#include <immintrin.h>
+#define SYSTOLIC_ARRAY_FUNCTIONAL_AVX512_VNNI 1
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define SYSTOLIC_ARRAY_FUNCTIONAL_AVX2 1
+#endif
+
+#include "conv.h"
+#include "SystolicArrayCore.h"
+
+template <typename IDTYPE, typename WDTYPE, typename ODTYPE, int OC0, int IC0, int accumbuffersize>
+class SystolicArrayFunctional
+{
+public:
+    SystolicArrayFunctional() : layer_runs(0), skipped_macs(0) {
+        for (int k = 0; k < IC0; k++) {
+            for (int j = 0; j < 2 * OC0; j++) {
+                w_pairs[k][j] = 0;
+            }
+        }
+    }
+
+    void run(
+        ac_channel<PackedInt<ARRAY_INPUT_PRECISION, IC0> > &input,
+        ac_channel<PackedInt<INPUT_PRECISION, IC0> > &input_hi,
+        ac_channel<PackedInt<ARRAY_WEIGHT_PRECISION, OC0> > &weight,
+        ac_channel<PackedInt<SPARSE_INDEX_PRECISION, OC0> > &weight_index,
+        ac_channel<PackedInt<OUTPUT_PRECISION, OC0> > &output,
+        ac_channel<uint_32> &skippedOut,
+        ac_channel<Params> &paramsIn,
+        ac_channel<LoopIndices> &loopIndicesIn)
+    {
+        while(paramsIn.available(1))
+        {
+            Params params = paramsIn.read();
+            int tile_size = window_pixels(params);
+            int num_windows = params.IC1 * params.FX * params.FY;
+            int ic1_bound = params.IC1;
+            int fx_bound = params.FX;
+            int fy_bound = params.FY;
+            // Winograd: a window per transformed position, each with its own
+            // accumulation buffer rows
+            bool winograd = (params.CONV_MODE == CONV_MODE_WINOGRAD);
+            if (winograd) {
+                fx_bound = WINOGRAD_TILE;
+                fy_bound = WINOGRAD_TILE;
+                num_windows = params.IC1 * WINOGRAD_POSITIONS;
+            }
+            // depthwise: one window per fy, streaming the N*OY0 input rows of the tile
+            bool depthwise = (params.CONV_MODE == CONV_MODE_DEPTHWISE);
+            // int4: the two channels of a packed value are a pair of the dot product
+            bool int4 = (params.PRECISION == PRECISION_INT4);
+            // sparse: the 2*IC0 channels of channel tiles 2*ic1 and 2*ic1+1 are pairs
+            bool sparse = (params.SPARSE != 0);
+            int pairs = (int4 || sparse) ? IC0 : IC0_PAIRS;
+            int ix0 = (params.OX0 - 1) * params.STRIDE + params.FX;
+            if (depthwise) {
+                num_windows = params.FY;
+                ic1_bound = 1;
+                fx_bound = 1;
+            }
+            if (sparse) {
+                ic1_bound = params.IC1 / 2;
+                num_windows = ic1_bound * params.FX * params.FY;
+            }
+            uint32_t layer_run_count = params.OX1 * params.OY1 * params.OC1;
+            if (params.CONV_MODE == CONV_MODE_GEMM) {
+                num_windows = ic1_bound * params.OX1 * params.OY1 * params.OC1;
+                layer_run_count = 1;
+            }
+
+            for (int w = 0; w < num_windows; w++) {
+                if (w != 0) {
+                    params = paramsIn.read();
+                }
+                LoopIndices loopIndices = loopIndicesIn.read();
+                bool first = (loopIndices.ic1_idx == 0 &&
+                              (winograd || (loopIndices.fx_idx == 0 && loopIndices.fy_idx == 0)));
+                bool last = (loopIndices.ic1_idx == ic1_bound-1 &&
+                             (winograd || (loopIndices.fx_idx == fx_bound-1 && loopIndices.fy_idx == fy_bound-1)));
+                int base = 0;
+                if (winograd) {
+                    base = (loopIndices.fx_idx * fy_bound + loopIndices.fy_idx) * tile_size;
+                }
+
+                // Weight rows, with pairs of consecutive input channels interleaved
+                // per output channel: w_pairs[i/2][2*j + i%2] = weight[i][j], or the
+                // two int4 channels of weight[i][j] in w_pairs[i][2*j], w_pairs[i][2*j + 1].
+                // Sparse: slot i of column j is channel c = 4*(i/2) + index of the 2*IC0
+                if (sparse) {
+                    for (int k = 0; k < IC0; k++) {
+                        for (int j = 0; j < 2 * OC0; j++) {
+                            w_pairs[k][j] = 0;
+                        }
+                    }
+                }
+                for (int i = 0; i < IC0; i++) {
+                    PackedInt<ARRAY_WEIGHT_PRECISION, OC0> w_row = weight.read();
+                    PackedInt<SPARSE_INDEX_PRECISION, OC0> w_index;
+                    if (sparse) {
+                        w_index = weight_index.read();
+                    }
+                    for (int j = 0; j < OC0; j++) {
+                        if (sparse) {
+                            ac_int<SPARSE_INDEX_PRECISION, false> index = w_index.value[j];
+                            int c = SPARSE_GROUP * (i / 2) + index.to_int();
+                            w_pairs[c/2][2*j + c%2] += (int16_t) w_row.value[j].to_int();
+                        } else if (int4) {
+                            w_pairs[i][2*j] = (int16_t) unpack_int4(w_row.value[j], 0);
+                            w_pairs[i][2*j + 1] = (int16_t) unpack_int4(w_row.value[j], 1);
+                        } else {
+                            w_pairs[i/2][2*j + i%2] = (int16_t) w_row.value[j].to_int();
+                        }
+                    }
+                }
+
+                if (depthwise) {
+                    depthwise_window(input, params, ix0, first);
+                } else {
+                    for (int p = 0; p < tile_size; p++) {
+                        PackedInt<ARRAY_INPUT_PRECISION, IC0> in_col = input.read();
+                        int16_t x[IC0 * 2];
+                        x[IC0_PAIRS * 2 - 1] = 0;
+                        if (sparse) {
+                            PackedInt<INPUT_PRECISION, IC0> in_col_hi = input_hi.read();
+                            for (int i = 0; i < IC0; i++) {
+                                x[IC0 + i] = (int16_t) in_col_hi.value[i].to_int();
+                            }
+                        }
+                        for (int i = 0; i < IC0; i++) {
+                            if (int4) {
+                                x[2*i] = (int16_t) unpack_int4(in_col.value[i], 0);
+                                x[2*i + 1] = (int16_t) unpack_int4(in_col.value[i], 1);
+                            } else {
+                                x[i] = (int16_t) in_col.value[i].to_int();
+                            }
+                        }
+                        // rows of the array with all inputs zero, a sparse row group is 2 rows
+                        for (int i = 0; i < IC0; i++) {
+                            if (sparse) {
+                                const int16_t *group = &x[SPARSE_GROUP * (i / 2)];
+                                skipped_macs += (group[0] == 0 && group[1] == 0 && group[2] == 0 && group[3] == 0) ? OC0 : 0;
+                            } else {
+                                skipped_macs += (in_col.value[i] == 0) ? OC0 : 0;
+                            }
+                        }
+                        if (first) {
+                            for (int j = 0; j < OC0; j++) {
+                                accumulation_buffer[base + p][j] = 0;
+                            }
+                        }
+                        mac_row(x, pairs, accumulation_buffer[base + p]);
+                    }
+                }
+
+                if (last) {
+                    for (int p = 0; p < tile_size; p++) {
+                        PackedInt<OUTPUT_PRECISION, OC0> output_row;
+                        for (int j = 0; j < OC0; j++) {
+                            output_row.value[j] = accumulation_buffer[base + p][j];
+                        }
+                        output.write(output_row);
+                    }
+                }
+            }
+
+            if (++layer_runs == layer_run_count) {
+                skippedOut.write(skipped_macs);
+                skipped_macs = 0;
+                layer_runs = 0;
+            }
+        }
+    }
+
+private:
+    static const int IC0_PAIRS = (IC0 + 1) / 2;
+
+    // signed int4 channel half (0: bits [3:0], 1: bits [7:4]) of a packed value
+    static int unpack_int4(ac_int<ARRAY_INPUT_PRECISION> value, int half)
+    {
+        ac_int<4, true> channel = value.template slc<4>(4 * half);
+        return channel.to_int();
+    }
+
+    // acc[n][oy0][ox0][j] += sum_fx x[n][oy0][STRIDE*ox0+fx][j] * weight[fx][j] over the
+    // input rows of one depthwise window
+    void depthwise_window(ac_channel<PackedInt<ARRAY_INPUT_PRECISION, IC0> > &input, const Params &params, int ix0, bool first)
+    {
+        int fx_size = params.FX;
+        std::vector<int16_t> x(ix0 * IC0);
+        int p = 0;
+        for (int r = 0; r < params.N * params.OY0; r++) {
+            for (int ix = 0; ix < ix0; ix++) {
+                PackedInt<ARRAY_INPUT_PRECISION, IC0> in_col = input.read();
+                for (int j = 0; j < IC0; j++) {
+                    x[ix * IC0 + j] = (int16_t) in_col.value[j].to_int();
+                }
+            }
+            for (int ox0 = 0; ox0 < params.OX0; ox0++, p++) {
+                for (int j = 0; j < OC0 && j < IC0; j++) {
+                    uint32_t sum = first ? 0 : (uint32_t) accumulation_buffer[p][j];
+                    for (int fx = 0; fx < fx_size; fx++) {
+                        sum += (uint32_t) (x[(ox0 * params.STRIDE + fx) * IC0 + j] * w_pairs[fx/2][2*j + fx%2]);
+                    }
+                    accumulation_buffer[p][j] = (int32_t) sum;
+                }
+            }
+        }
+    }
+
+    // acc[j] += sum_i x[i] * weight[i][j] over 2*pairs inputs, wrapping at 32 bits
+    // like the PE psums
+    void mac_row(const int16_t *x, int pairs, int32_t *acc)
+    {
+        // only the pairs with a nonzero input, k_index[n] is the pair of x_pairs[n]
+        int32_t x_pairs[IC0];
+        int k_index[IC0];
+        int nonzero = 0;
+        for (int k = 0; k < pairs; k++) {
+            int32_t x_pair = (int32_t) ((uint32_t) (uint16_t) x[2*k] | ((uint32_t) (uint16_t) x[2*k+1] << 16));
+            if (x_pair != 0) {
+                x_pairs[nonzero] = x_pair;
+                k_index[nonzero++] = k;
+            }
+        }
+        int j = 0;
+#if SYSTOLIC_ARRAY_FUNCTIONAL_AVX512_VNNI
+        for (; j + 16 <= OC0; j += 16) {
+            __m512i sum = _mm512_loadu_si512((const void *) &acc[j]);
+            for (int n = 0; n < nonzero; n++) {
+                __m512i xv = _mm512_set1_epi32(x_pairs[n]);
+                __m512i wv = _mm512_loadu_si512((const void *) &w_pairs[k_index[n]][2*j]);
+                sum = _mm512_dpwssd_epi32(sum, xv, wv);
+            }
+            _mm512_storeu_si512((void *) &acc[j], sum);
+        }
+#elif SYSTOLIC_ARRAY_FUNCTIONAL_AVX2
+        for (; j + 8 <= OC0; j += 8) {
+            __m256i sum = _mm256_loadu_si256((const __m256i *) &acc[j]);
+            for (int n = 0; n < nonzero; n++) {
+                __m256i xv = _mm256_set1_epi32(x_pairs[n]);
+                __m256i wv = _mm256_loadu_si256((const __m256i *) &w_pairs[k_index[n]][2*j]);
+                sum = _mm256_add_epi32(sum, _mm256_madd_epi16(xv, wv));
+            }
+            _mm256_storeu_si256((__m256i *) &acc[j], sum);
+        }
+#endif
+        for (; j < OC0; j++) {
+            uint32_t sum = (uint32_t) acc[j];
+            for (int n = 0; n < nonzero; n++) {
+                int k = k_index[n];
+                sum += (uint32_t) (x[2*k] * w_pairs[k][2*j] + x[2*k+1] * w_pairs[k][2*j+1]);
+            }
+            acc[j] = (int32_t) sum;
+        }
+    }
+
+    int16_t w_pairs[IC0][2 * OC0];
+    int32_t accumulation_buffer[accumbuffersize][OC0];
+    // skipped MACs of the current layer, counted like SystolicArrayCore
+    uint32_t layer_runs;
+    uint32_t skipped_macs;
+};
+
+#endif
@@ -2,15 +2,92 @@
 #define WEIGHT_DOUBLE_BUFFER_H
 
 
-template <int size, int IC0, int OC0>
+// Rows of OC0 weights in a kernel tile, a depthwise filter has a single weight per
+// tap and channel, a sparse window has IC0 slot rows and an index row per 4 of them,
+// a Winograd channel tile has IC0 rows per transformed position
+template <int IC0>
+uint_32 weight_tile_rows(const Params &params)
+{
+    if (params.CONV_MODE == CONV_MODE_DEPTHWISE) {
+        return params.FX * params.FY;
+    }
+    if (params.CONV_MODE == CONV_MODE_WINOGRAD) {
+        return WINOGRAD_POSITIONS * IC0 * params.IC1;
+    }
+    if (params.SPARSE != 0) {
+        return params.FX * params.FY * (IC0 + IC0 / SPARSE_GROUP) * (params.IC1 / 2);
+    }
+    return params.FX * params.FY * IC0 * params.IC1;
+}
+
+// Rows of OC0 values a kernel tile takes on weight_serial, a Winograd row is streamed
+// as its low and its high bytes
+template <int IC0>
+uint_32 weight_stream_rows(const Params &params)
+{
+    if (params.CONV_MODE == CONV_MODE_WINOGRAD) {
+        return 2 * weight_tile_rows<IC0>(params);
+    }
+    return weight_tile_rows<IC0>(params);
+}
+
+// Expands the rows of the ZERO_MASK weight format one value at a time, see
+// Params.WEIGHT_COMPRESSION
+template <int OC0>
+struct ZeroMaskDecoder {
+    static const int MASK_BYTES = OC0 / WEIGHT_PRECISION;
+
+    PackedInt<WEIGHT_PRECISION, OC0> row;
+    ac_int<OC0, false> mask;  // nonzero columns of the row still to come
+    uint_16 header;           // mask bytes of the row read so far
+
+    void reset() {
+        header = 0;
+    }
+
+    // takes the next value of the stream, true when it completes the row
+    bool push(ac_int<WEIGHT_PRECISION> value) {
+        if (header < MASK_BYTES) {
+            if (header == 0) {
+                #pragma hls_unroll yes
+                for (int j = 0; j < OC0; j++) {
+                    row.value[j] = 0;
+                }
+            }
+            mask.set_slc(WEIGHT_PRECISION * header, (ac_int<WEIGHT_PRECISION, false>) value);
+            header++;
+        } else {
+            // the lowest nonzero column left
+            int column = 0;
+            #pragma hls_unroll yes
+            for (int j = OC0 - 1; j >= 0; j--) {
+                if (mask[j]) {
+                    column = j;
+                }
+            }
+            row.value[column] = value;
+            mask.set_slc(column, (ac_int<1, false>) 0);
+        }
+        if (header == MASK_BYTES && mask == 0) {
+            header = 0;
+            return true;
+        }
+        return false;
+    }
+};
+
+// Kernel tile oc1 goes to the buffer of core oc1 % cores, see Multi-core in conv.h.
+// The buffer rows have the ARRAY_WEIGHT_PRECISION of the array, streamed rows are
+// sign extended or, for Winograd, joined with the row of their high bytes.
+template <int size, int IC0, int OC0, int lanes, int cores>
 class WeightDoubleBufferWriter{
 public:
     WeightDoubleBufferWriter(){}
 
     #pragma hls_design interface
     void CCS_BLOCK(run)(ac_channel<Params> &paramsIn,
-                        ac_channel<PackedInt<WEIGHT_PRECISION, 4> > &din,
-                        ac_channel<chanStruct<PackedInt<WEIGHT_PRECISION, OC0>, size> > &dout)
+                        ac_channel<PackedInt<WEIGHT_PRECISION, lanes> > &din,
+                        ac_channel<chanStruct<PackedInt<ARRAY_WEIGHT_PRECISION, OC0>, size> > dout[cores])
     {
         // -------------------------------
         // Your code starts here
@@ -25,29 +102,76 @@ public:
          * if we decided connect our module to a memory simulation that writes din sporadically the
          * module will fail on a non-blocking din read in a C sim without the guard.
          */
-        while (paramsIn.available(1) && din.available((paramsIn[0].OX1.to_int() * paramsIn[0].OY1.to_int() * paramsIn[0].OC1.to_int() *
-                                                       paramsIn[0].IC1.to_int()*IC0*paramsIn[0].FX.to_int()*paramsIn[0].FY.to_int()) / 4))
+        // the length of a compressed stream is only known once it is decoded
+        while (paramsIn.available(1) && din.available(paramsIn[0].WEIGHT_COMPRESSION != WEIGHT_COMPRESSION_NONE ? 1 :
+                                                      (paramsIn[0].LOOP_ORDER == LOOP_ORDER_WEIGHT_STATIONARY ? 1 : paramsIn[0].OX1.to_int() * paramsIn[0].OY1.to_int()) *
+                                                      paramsIn[0].OC1.to_int() *
+                                                      ((weight_stream_rows<IC0>(paramsIn[0]).to_int() * OC0 + lanes - 1) / lanes)))
         #endif
         {
             Params params = paramsIn.read();
-            ac_int<ac::log2_ceil<size+1>::val, false> tileSize = params.FX * params.FY * IC0 * params.IC1;
+            // rows streamed per tile, twice the buffer rows for Winograd
+            ac_int<ac::log2_ceil<2*size+1>::val, false> tileSize = weight_stream_rows<IC0>(params);
+            bool winograd = (params.CONV_MODE == CONV_MODE_WINOGRAD);
+            // weight stationary: every OC1 tile is loaded only once per layer
+            uint_32 numTiles = params.OC1;
+            if (params.LOOP_ORDER != LOOP_ORDER_WEIGHT_STATIONARY) {
+                numTiles = numTiles * params.OX1 * params.OY1;
+            }
+            uint_16 oc1 = 0;  // kernel tile of tile t
             #pragma hls_pipeline_init_interval 1
-            TILES: for (int t = 0; t < params.OX1 * params.OY1 * params.OC1; t++) {
-                chanStruct<PackedInt<WEIGHT_PRECISION, OC0>,size> tmp;
-                TILE: for (int i = 0; i < tileSize; i++) {
-                    // each packet contains 4 values, pack OC0 tgt into one row
-                    PackedInt<WEIGHT_PRECISION, OC0> memRow;  // one row in the memory
-                    for (int j = 0; j < OC0; j=j+4) {
-                        PackedInt<WEIGHT_PRECISION, 4> packet = din.read();
+            TILES: for (int t = 0; t < numTiles; t++) {
+                chanStruct<PackedInt<ARRAY_WEIGHT_PRECISION, OC0>,size> tmp;
+                PackedInt<WEIGHT_PRECISION, OC0> low;  // Winograd: low bytes of the next buffer row
+                if (params.WEIGHT_COMPRESSION == WEIGHT_COMPRESSION_ZERO_MASK) {
+                    // the lanes values of a packet are decoded in order, a packet can
+                    // complete several rows; the rest of the tile's last packet is padding
+                    ZeroMaskDecoder<OC0> decoder;
+                    decoder.reset();
+                    ac_int<ac::log2_ceil<2*size+1>::val, false> row = 0;
+                    ZERO_MASK: while (row < tileSize) {
+                        PackedInt<WEIGHT_PRECISION, lanes> packet = din.read();
                         #pragma hls_unroll yes
-                        for (int k = 0; k < 4; k++) {
-                            memRow.value[j+k] = packet.value[k];
+                        for (int k = 0; k < lanes; k++) {
+                            if (row < tileSize && decoder.push(packet.value[k])) {
+                                store_row(tmp, low, row, decoder.row, winograd);
+                                row++;
+                            }
+                        }
+                    }  // ZERO_MASK
+                } else {
+                    // each packet contains lanes values: a row takes OC0/lanes packets, or with
+                    // lanes > OC0 a packet carries lanes/OC0 rows and the last one of a tile is padded
+                    const int row_lanes = (lanes < OC0) ? lanes : OC0;
+                    const int packets_per_row = OC0 / row_lanes;
+                    const int rows_per_packet = lanes / row_lanes;
+                    TILE: for (int i = 0; i < tileSize; i += rows_per_packet) {
+                        PackedInt<WEIGHT_PRECISION, OC0> memRow[rows_per_packet];  // rows in the memory
+                        for (int j = 0; j < packets_per_row; j++) {
+                            PackedInt<WEIGHT_PRECISION, lanes> packet = din.read();
+                            #pragma hls_unroll yes
+                            for (int k = 0; k < lanes; k++) {
+                                memRow[k / row_lanes].value[j * row_lanes + k % row_lanes] = packet.value[k];
+                            }
+                        }
+                        #pragma hls_unroll yes
+                        for (int r = 0; r < rows_per_packet; r++) {
+                            if (i + r < tileSize) {
+                                store_row(tmp, low, i + r, memRow[r], winograd);
+                            }
                         }
-                    }
-                    tmp.data[i] = memRow;
 
-                }  // TILE
-                dout.write(tmp);
+                    }  // TILE
+                }
+                #pragma hls_unroll yes
+                for (int k = 0; k < cores; k++) {
+                    if (oc1 % cores == k) {
+                        dout[k].write(tmp);
+                    }
+                }
+                if (++oc1 == params.OC1) {
+                    oc1 = 0;
+                }
             } // TILES
         }
 
@@ -55,6 +179,35 @@ public:
         // Your code ends here
         // -------------------------------
     }
+
+private:
+    // Stores streamed row r of a tile. A Winograd buffer row r/2 comes as the low
+    // bytes of its weights, kept in low, followed by the high bytes.
+    static void store_row(chanStruct<PackedInt<ARRAY_WEIGHT_PRECISION, OC0>,size> &tmp,
+                          PackedInt<WEIGHT_PRECISION, OC0> &low, uint_32 r,
+                          PackedInt<WEIGHT_PRECISION, OC0> value, bool winograd)
+    {
+        if (!winograd) {
+            PackedInt<ARRAY_WEIGHT_PRECISION, OC0> row;
+            #pragma hls_unroll yes
+            for (int j = 0; j < OC0; j++) {
+                row.value[j] = value.value[j];
+            }
+            tmp.data[r] = row;
+        } else if (r % 2 == 0) {
+            low = value;
+        } else {
+            PackedInt<ARRAY_WEIGHT_PRECISION, OC0> row;
+            #pragma hls_unroll yes
+            for (int j = 0; j < OC0; j++) {
+                ac_int<2*WEIGHT_PRECISION, true> weight;
+                weight.set_slc(0, (ac_int<WEIGHT_PRECISION, false>) low.value[j]);
+                weight.set_slc(WEIGHT_PRECISION, value.value[j]);
+                row.value[j] = weight;
+            }
+            tmp.data[r / 2] = row;
+        }
+    }
 };
 
 template <int size, int IC0, int OC0>
@@ -64,8 +217,9 @@ public:
 
     #pragma hls_design interface
     void CCS_BLOCK(run)(ac_channel<Params> &paramsIn,
-                        ac_channel<chanStruct<PackedInt<WEIGHT_PRECISION, OC0>,size> > &din, 
-                        ac_channel<PackedInt<WEIGHT_PRECISION, OC0> > &dout)
+                        ac_channel<chanStruct<PackedInt<ARRAY_WEIGHT_PRECISION, OC0>,size> > &din, 
+                        ac_channel<PackedInt<ARRAY_WEIGHT_PRECISION, OC0> > &dout,
+                        ac_channel<PackedInt<SPARSE_INDEX_PRECISION, OC0> > &indexOut)
     {
         // -------------------------------
         // Your code starts here
@@ -76,16 +230,81 @@ public:
         #endif
         {
             Params params = paramsIn.read();
-            ac_int<ac::log2_ceil<size+1>::val, false> tileSize = params.FX * params.FY * IC0 * params.IC1;
+            // rows streamed out per tile: IC0 per window, in depthwise mode a window is
+            // one filter row of FX taps followed by IC0-FX zero rows
+            bool depthwise = (params.CONV_MODE == CONV_MODE_DEPTHWISE);
+            uint_32 streamSize = params.FX * params.FY * IC0 * params.IC1;
+            if (depthwise) {
+                streamSize = params.FY * IC0;
+            }
+            // Winograd: IC0 rows per transformed position
+            if (params.CONV_MODE == CONV_MODE_WINOGRAD) {
+                streamSize = weight_tile_rows<IC0>(params);
+            }
+            // sparse: every buffer row is read once, an index row is kept for the 4
+            // slot rows after it and each slot row leaves with its 2 bit indices
+            bool sparse = (params.SPARSE != 0);
+            if (sparse) {
+                streamSize = weight_tile_rows<IC0>(params);
+            }
+            PackedInt<ARRAY_WEIGHT_PRECISION, OC0> zero;
+            #pragma hls_unroll yes
+            for (int j = 0; j < OC0; j++) {
+                zero.value[j] = 0;
+            }
 
-            // read in new tile for every oc1
+            // weight stationary: read in one tile per oc1 and replay it for every spatial tile
+            // otherwise: read in new tile for every oc1 of every spatial tile
+            uint_32 numTiles = params.OC1;
+            uint_16 reuse = params.OX1 * params.OY1;
+            if (params.LOOP_ORDER != LOOP_ORDER_WEIGHT_STATIONARY) {
+                numTiles = numTiles * reuse;
+                reuse = 1;
+            }
             #pragma hls_pipeline_init_interval 1
-            TILES: for (int t = 0; t < params.OX1 * params.OY1 * params.OC1; t++) {
-                chanStruct<PackedInt<WEIGHT_PRECISION, OC0>,size> tmp;
+            TILES: for (int t = 0; t < numTiles; t++) {
+                chanStruct<PackedInt<ARRAY_WEIGHT_PRECISION, OC0>,size> tmp;
                 tmp = din.read();
-                TILE: for (int i = 0; i < tileSize; i++) {
-                    dout.write(tmp.data[i]);
-                } // TILE
+                REUSE: for (int r = 0; r < reuse; r++) {
+                    ac_int<ac::log2_ceil<size+1>::val, false> address = 0;
+                    uint_16 row = 0;  // row of the window
+                    uint_16 slot = 0;  // sparse: 0 for an index row, 1..4 for a slot row
+                    PackedInt<ARRAY_WEIGHT_PRECISION, OC0> indices;
+                    TILE: for (int i = 0; i < streamSize; i++) {
+                        if (sparse) {
+                            PackedInt<ARRAY_WEIGHT_PRECISION, OC0> memRow = tmp.data[address];
+                            address++;
+                            if (slot == 0) {
+                                indices = memRow;
+                            } else {
+                                PackedInt<SPARSE_INDEX_PRECISION, OC0> index;
+                                #pragma hls_unroll yes
+                                for (int j = 0; j < OC0; j++) {
+                                    index.value[j] = indices.value[j].template slc<SPARSE_INDEX_PRECISION>(SPARSE_INDEX_PRECISION * (slot - 1));
+                                }
+                                dout.write(memRow);
+                                indexOut.write(index);
+                            }
+                            if (slot == SPARSE_GROUP) {
+                                slot = 0;
+                            } else {
+                                slot++;
+                            }
+                            continue;
+                        }
+                        if (depthwise && row >= params.FX) {
+                            dout.write(zero);
+                        } else {
+                            dout.write(tmp.data[address]);
+                            address++;
+                        }
+                        if (row == IC0 - 1) {
+                            row = 0;
+                        } else {
+                            row++;
+                        }
+                    } // TILE
+                } // REUSE
             } // TILES
         }
 
@@ -95,14 +314,19 @@ public:
     }
 };
 
-template <int size, int IC0, int OC0>
+/*
+ * One writer and a buffer and reader per core, every reader replays the kernel
+ * tiles of its core, see Multi-core in conv.h.
+ */
+template <int size, int IC0, int OC0, int lanes, int cores>
 class WeightDoubleBuffer{
 public:
   WeightDoubleBuffer(){}
 
   #pragma hls_design interface
-  void CCS_BLOCK(run)(ac_channel<PackedInt<WEIGHT_PRECISION, 4> > &weights_in, 
-                      ac_channel<PackedInt<WEIGHT_PRECISION, OC0> > &weights_out,
+  void CCS_BLOCK(run)(ac_channel<PackedInt<WEIGHT_PRECISION, lanes> > &weights_in, 
+                      ac_channel<PackedInt<ARRAY_WEIGHT_PRECISION, OC0> > weights_out[cores],
+                      ac_channel<PackedInt<SPARSE_INDEX_PRECISION, OC0> > weight_index_out[cores],
                       ac_channel<Params> &paramsIn)
     {
         #ifndef __SYNTHESIS__
@@ -116,22 +340,31 @@ public:
             // assert(block_size <= size);
             // #endif
 
-            weightDoubleBufferReaderParams.write(params);
+            // a core without kernel tiles in the layer sits it out
+            #pragma hls_unroll yes
+            for (int k = 0; k < cores; k++) {
+                if (k < params.OC1) {
+                    weightDoubleBufferReaderParams[k].write(core_params(params, k, cores));
+                }
+            }
             weightDoubleBufferWriterParams.write(params);
 
             weightDoubleBufferWriter.run(weightDoubleBufferWriterParams, weights_in, mem);
-            weightDoubleBufferReader.run(weightDoubleBufferReaderParams, mem, weights_out);
+            #pragma hls_unroll yes
+            for (int k = 0; k < cores; k++) {
+                weightDoubleBufferReader[k].run(weightDoubleBufferReaderParams[k], mem[k], weights_out[k], weight_index_out[k]);
+            }
         }
     }
 
 private:
-    ac_channel<chanStruct<PackedInt<WEIGHT_PRECISION, OC0>,size> > mem;
+    ac_channel<chanStruct<PackedInt<ARRAY_WEIGHT_PRECISION, OC0>,size> > mem[cores];
     
-    WeightDoubleBufferWriter<size, IC0, OC0> weightDoubleBufferWriter;
+    WeightDoubleBufferWriter<size, IC0, OC0, lanes, cores> weightDoubleBufferWriter;
     ac_channel<Params> weightDoubleBufferWriterParams;
     
-    WeightDoubleBufferReader<size, IC0, OC0> weightDoubleBufferReader;
-    ac_channel<Params> weightDoubleBufferReaderParams;
+    WeightDoubleBufferReader<size, IC0, OC0> weightDoubleBufferReader[cores];
+    ac_channel<Params> weightDoubleBufferReaderParams[cores];
 };
 
 
@@ -6,7 +6,7 @@
 #include <fstream>
 #include "conv_tb_params.h"
 
-bool pcompare(PackedInt<WEIGHT_PRECISION, OC0> expected, PackedInt<WEIGHT_PRECISION, OC0> actual) {
+bool pcompare(PackedInt<WEIGHT_PRECISION, OC0> expected, PackedInt<ARRAY_WEIGHT_PRECISION, OC0> actual) {
     bool match = true;
     for (int i = 0; i < OC0; i++) {
         if (expected.value[i] != actual.value[i]) {
@@ -28,7 +28,8 @@ int run_layer(Params params) {
     static WDTYPE weight[FILTER_SIZE][FILTER_SIZE][IFMAP_CHANNELS][OFMAP_CHANNELS]; 
 
     static ac_channel<PackedInt<WEIGHT_PRECISION, 4> > weights_in_stream;
-    static ac_channel<PackedInt<WEIGHT_PRECISION, OC0> > weights_out_stream;
+    static ac_channel<PackedInt<ARRAY_WEIGHT_PRECISION, OC0> > weights_out_stream;
+    static ac_channel<PackedInt<SPARSE_INDEX_PRECISION, OC0> > weight_index_out_stream;
     static ac_channel<Params> params_stream;
     
     int errCnt = 0;
@@ -74,8 +75,8 @@ int run_layer(Params params) {
 
     // Run HLS
     printf("Running HLS C design\n");
-    WeightDoubleBuffer<WEIGHT_BUFFER_SIZE, IC0, OC0> weightdoublebuffer_dut;
-    weightdoublebuffer_dut.run(weights_in_stream, weights_out_stream, params_stream); 
+    WeightDoubleBuffer<WEIGHT_BUFFER_SIZE, IC0, OC0, 4, 1> weightdoublebuffer_dut;
+    weightdoublebuffer_dut.run(weights_in_stream, &weights_out_stream, &weight_index_out_stream, params_stream); 
 
     printf("Loading correct comparison\n");
 
@@ -113,7 +114,7 @@ int run_layer(Params params) {
     printf("\nChecking Output\n\n"); 
     // Compare the gold results with the actual model
     for (PackedInt<WEIGHT_PRECISION, OC0> weight_expected: gold_weights) {
-        PackedInt<WEIGHT_PRECISION, OC0> weight_actual = weights_out_stream.read();
+        PackedInt<ARRAY_WEIGHT_PRECISION, OC0> weight_actual = weights_out_stream.read();
         if (!pcompare(weight_expected, weight_actual)) {
               errCnt++;
               if (errCnt < 10) {
@@ -140,7 +141,27 @@ CCS_MAIN(int argc, char *argv[])
         IC1,
         FX,
         FY,
-        STRIDE
+        STRIDE,
+        LOOP_ORDER,
+        RELU,
+        REQUANTIZE,
+        PAD_TOP,
+        PAD_BOTTOM,
+        PAD_LEFT,
+        PAD_RIGHT,
+        N,
+        CONV_MODE,
+        RESIDUAL,
+        RESIDUAL_SHIFT,
+        POOL,
+        POOL_SIZE,
+        POOL_STRIDE,
+        POOL_PAD,
+        POOL_SCALE,
+        POOL_SHIFT,
+        PRECISION,
+        SPARSE,
+        WEIGHT_COMPRESSION
     };
     errCnt += run_layer<OY0 * OY1, OX0 * OX1, OC0 * OC1, IC0 * IC1, FX, STRIDE, IC0, OC0>(params_resnet_layer);
     
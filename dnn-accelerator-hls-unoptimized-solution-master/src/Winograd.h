@@ -0,0 +1,282 @@
+#ifndef WINOGRAD_H
+#define WINOGRAD_H
+
+/*
+ * Winograd F(2x2, 3x3), see CONV_MODE_WINOGRAD in conv.h. With the 4x4 input patch d
+ * of a 2x2 output patch and the 3x3 filter g, the outputs are
+ *     Y = A^T [(G' g G'^T) . (B^T d B)] A / 4
+ * summed over the input channels, where . multiplies the 16 transformed positions
+ * one by one, which the systolic array does as one window per position.
+ */
+
+// Row i of B^T, the input transform
+inline int winograd_bt(int i, int k)
+{
+    const int bt[WINOGRAD_TILE][WINOGRAD_TILE] = {
+        {1,  0, -1,  0},
+        {0,  1,  1,  0},
+        {0, -1,  1,  0},
+        {0,  1,  0, -1}
+    };
+    return bt[i][k];
+}
+
+// Row a of A^T, the output transform
+inline int winograd_at(int a, int k)
+{
+    const int at[2][WINOGRAD_TILE] = {
+        {1, 1,  1,  0},
+        {0, 1, -1, -1}
+    };
+    return at[a][k];
+}
+
+// Rows the input buffer sends to a core for one of its output tiles, the windows
+// of the tile times the pixels of a window, see SystolicArrayCore
+inline uint_32 array_tile_input_rows(const Params &params)
+{
+    if (params.CONV_MODE == CONV_MODE_DEPTHWISE) {
+        uint_16 ix0 = (params.OX0 - 1) * params.STRIDE + params.FX;
+        return params.FY * params.N * params.OY0 * ix0;
+    }
+    uint_16 ic1_bound = params.IC1;
+    if (params.SPARSE != 0) {
+        ic1_bound = params.IC1 / 2;
+    }
+    return ic1_bound * params.FX * params.FY * params.N * params.OY0 * params.OX0;
+}
+
+/*
+ * Input transform of a core, between the InputDoubleBufferReader and the array.
+ * The input patches of a channel tile come in one after the other and their
+ * transformed positions V = B^T d B go out one position at a time, so a channel
+ * tile is transformed into one bank of planeMem while the previous one goes out
+ * of the other. Other layers pass through, sign extended to the array inputs.
+ */
+template <int IC0, int size>
+class WinogradInputTransform{
+public:
+    WinogradInputTransform(){}
+
+    #pragma hls_design interface
+    void CCS_BLOCK(run)(ac_channel<PackedInt<INPUT_PRECISION, IC0> > &input,
+                        ac_channel<PackedInt<ARRAY_INPUT_PRECISION, IC0> > &output,
+                        ac_channel<Params> &paramsIn)
+    {
+        #ifndef __SYNTHESIS__
+        while(paramsIn.available(1))
+        #endif
+        {
+            Params params = paramsIn.read();
+            uint_32 num_tiles = params.OX1 * params.OY1 * params.OC1;
+
+            if (params.CONV_MODE != CONV_MODE_WINOGRAD) {
+                uint_32 rows = num_tiles * array_tile_input_rows(params);
+                #pragma hls_pipeline_init_interval 1
+                for (uint_32 i = 0; i < rows; i++) {
+                    PackedInt<INPUT_PRECISION, IC0> in = input.read();
+                    PackedInt<ARRAY_INPUT_PRECISION, IC0> out;
+                    #pragma hls_unroll yes
+                    for (int c = 0; c < IC0; c++) {
+                        out.value[c] = in.value[c];
+                    }
+                    output.write(out);
+                }
+            } else {
+                uint_16 patches = window_pixels(params);
+                uint_32 planes = num_tiles * params.IC1;
+                uint_16 plane_rows = WINOGRAD_POSITIONS * patches;
+
+                // channel tile k is read in while channel tile k-1 goes out
+                PLANES: for (uint_32 k = 0; k <= planes; k++) {
+                    uint_16 in_patch = 0;
+                    uint_16 in_pos = 0;
+                    uint_16 out_patch = 0;
+                    uint_16 out_pos = 0;
+                    #pragma hls_pipeline_init_interval 1
+                    PLANE: for (uint_16 i = 0; i < plane_rows; i++) {
+                        if (k < planes) {
+                            // the patch rows shift in, the last row completes the patch
+                            #pragma hls_unroll yes
+                            for (int r = 0; r < WINOGRAD_POSITIONS - 1; r++) {
+                                patch[r] = patch[r + 1];
+                            }
+                            patch[WINOGRAD_POSITIONS - 1] = input.read();
+                            if (in_pos == WINOGRAD_POSITIONS - 1) {
+                                planeMem[k & 1][in_patch] = transform(patch);
+                                in_pos = 0;
+                                in_patch++;
+                            } else {
+                                in_pos++;
+                            }
+                        }
+                        if (k > 0) {
+                            output.write(planeMem[(k - 1) & 1][out_patch].value[out_pos]);
+                            if (out_patch == patches - 1) {
+                                out_patch = 0;
+                                out_pos++;
+                            } else {
+                                out_patch++;
+                            }
+                        }
+                    } // PLANE
+                } // PLANES
+            }
+        }
+    }
+
+private:
+    // V = B^T d B of the patch d, both in row major order
+    static PackedInt2D<ARRAY_INPUT_PRECISION, IC0, WINOGRAD_POSITIONS> transform(PackedInt<INPUT_PRECISION, IC0> d[WINOGRAD_POSITIONS])
+    {
+        PackedInt2D<ARRAY_INPUT_PRECISION, IC0, WINOGRAD_POSITIONS> v;
+        #pragma hls_unroll yes
+        for (int c = 0; c < IC0; c++) {
+            // t = B^T d
+            ac_int<INPUT_PRECISION+1, true> t[WINOGRAD_TILE][WINOGRAD_TILE];
+            #pragma hls_unroll yes
+            for (int i = 0; i < WINOGRAD_TILE; i++) {
+                #pragma hls_unroll yes
+                for (int j = 0; j < WINOGRAD_TILE; j++) {
+                    ac_int<INPUT_PRECISION+1, true> sum = 0;
+                    #pragma hls_unroll yes
+                    for (int k = 0; k < WINOGRAD_TILE; k++) {
+                        ac_int<INPUT_PRECISION, true> value = d[k * WINOGRAD_TILE + j].value[c];
+                        if (winograd_bt(i, k) == 1) {
+                            sum += value;
+                        } else if (winograd_bt(i, k) == -1) {
+                            sum -= value;
+                        }
+                    }
+                    t[i][j] = sum;
+                }
+            }
+            // V = t B, column j of B is row j of B^T
+            #pragma hls_unroll yes
+            for (int i = 0; i < WINOGRAD_TILE; i++) {
+                #pragma hls_unroll yes
+                for (int j = 0; j < WINOGRAD_TILE; j++) {
+                    ac_int<INPUT_PRECISION+2, true> sum = 0;
+                    #pragma hls_unroll yes
+                    for (int k = 0; k < WINOGRAD_TILE; k++) {
+                        if (winograd_bt(j, k) == 1) {
+                            sum += t[i][k];
+                        } else if (winograd_bt(j, k) == -1) {
+                            sum -= t[i][k];
+                        }
+                    }
+                    v.value[i * WINOGRAD_TILE + j].value[c] = sum;
+                }
+            }
+        }
+        return v;
+    }
+
+    PackedInt<INPUT_PRECISION, IC0> patch[WINOGRAD_POSITIONS];
+    // transformed patches of a channel tile, two banks
+    PackedInt2D<ARRAY_INPUT_PRECISION, IC0, WINOGRAD_POSITIONS> planeMem[2][size];
+};
+
+/*
+ * Output transform between the systolic array and the PostProcessor. The array
+ * hands over a Winograd tile one transformed position at a time, each position of
+ * every patch is added to the 2x2 outputs A^T M A of its patch in outMem, and the
+ * outputs / 4 leave in the (n, oy0, ox0) order of the other layers. The array only
+ * outputs during the last channel tile of a tile, so collecting and sending out a
+ * tile in turn keeps up with it. Other layers pass through.
+ */
+template <int OC0, int size>
+class WinogradOutputTransform{
+public:
+    WinogradOutputTransform(){}
+
+    #pragma hls_design interface
+    void CCS_BLOCK(run)(ac_channel<PackedInt<OUTPUT_PRECISION, OC0> > &input,
+                        ac_channel<PackedInt<OUTPUT_PRECISION, OC0> > &output,
+                        ac_channel<Params> &paramsIn)
+    {
+        #ifndef __SYNTHESIS__
+        while(paramsIn.available(1))
+        #endif
+        {
+            Params params = paramsIn.read();
+            uint_32 num_tiles = params.OX1 * params.OY1 * params.OC1;
+
+            if (params.CONV_MODE != CONV_MODE_WINOGRAD) {
+                uint_32 rows = num_tiles * array_tile_rows(params);
+                #pragma hls_pipeline_init_interval 1
+                for (uint_32 i = 0; i < rows; i++) {
+                    output.write(input.read());
+                }
+            } else {
+                uint_16 patches = window_pixels(params);
+                uint_16 tile_rows = array_tile_rows(params);
+                uint_16 patch_width = params.OX0 / 2;
+                uint_16 patch_height = params.OY0 / 2;
+
+                TILES: for (uint_32 t = 0; t < num_tiles; t++) {
+                    // transformed position k of every patch p
+                    uint_16 k = 0;
+                    uint_16 p = 0;
+                    #pragma hls_pipeline_init_interval 1
+                    COLLECT: for (uint_16 i = 0; i < tile_rows; i++) {
+                        PackedInt<OUTPUT_PRECISION, OC0> m = input.read();
+                        PackedInt2D<OUTPUT_PRECISION, OC0, 4> acc = outMem[p];
+                        #pragma hls_unroll yes
+                        for (int a = 0; a < 2; a++) {
+                            #pragma hls_unroll yes
+                            for (int b = 0; b < 2; b++) {
+                                int coefficient = winograd_at(a, k / WINOGRAD_TILE) * winograd_at(b, k % WINOGRAD_TILE);
+                                #pragma hls_unroll yes
+                                for (int j = 0; j < OC0; j++) {
+                                    ac_int<OUTPUT_PRECISION, true> sum = acc.value[2 * a + b].value[j];
+                                    if (k == 0) {
+                                        sum = 0;
+                                    }
+                                    if (coefficient == 1) {
+                                        sum += m.value[j];
+                                    } else if (coefficient == -1) {
+                                        sum -= m.value[j];
+                                    }
+                                    acc.value[2 * a + b].value[j] = sum;
+                                }
+                            }
+                        }
+                        outMem[p] = acc;
+                        if (p == patches - 1) {
+                            p = 0;
+                            k++;
+                        } else {
+                            p++;
+                        }
+                    } // COLLECT
+
+                    // output (oy0, ox0) of image n is (oy0 % 2, ox0 % 2) of patch
+                    // (n, oy0 / 2, ox0 / 2)
+                    SEND_N: for (uint_16 n = 0; n < params.N; n++) {
+                        SEND_Y: for (uint_16 oy0 = 0; oy0 < params.OY0; oy0++) {
+                            #pragma hls_pipeline_init_interval 1
+                            SEND_X: for (uint_16 ox0 = 0; ox0 < params.OX0; ox0++) {
+                                uint_16 patch = (n * patch_height + oy0 / 2) * patch_width + ox0 / 2;
+                                PackedInt<OUTPUT_PRECISION, OC0> sum = outMem[patch].value[2 * (oy0 % 2) + ox0 % 2];
+                                PackedInt<OUTPUT_PRECISION, OC0> out;
+                                #pragma hls_unroll yes
+                                for (int j = 0; j < OC0; j++) {
+                                    ac_int<OUTPUT_PRECISION, true> value = sum.value[j];
+                                    out.value[j] = value >> 2;
+                                }
+                                output.write(out);
+                            } // SEND_X
+                        } // SEND_Y
+                    } // SEND_N
+                } // TILES
+            }
+        }
+    }
+
+private:
+    // the 2x2 outputs of every patch of a tile, times 4
+    PackedInt2D<OUTPUT_PRECISION, OC0, 4> outMem[size];
+};
+
+#endif
@@ -42,22 +42,339 @@ struct Params {
    uint_16 FX;
    uint_16 FY;
    uint_16 STRIDE;
+
+   uint_16 LOOP_ORDER;
+
+   uint_16 RELU;
+   uint_16 REQUANTIZE;
+
+   // zero padding around the input image, generated on chip
+   uint_16 PAD_TOP;
+   uint_16 PAD_BOTTOM;
+   uint_16 PAD_LEFT;
+   uint_16 PAD_RIGHT;
+
+   // images in the batch, see below
+   uint_16 N;
+
+   uint_16 CONV_MODE;
+
+   // shortcut added to the accumulators, see below
+   uint_16 RESIDUAL;
+   uint_16 RESIDUAL_SHIFT;
+
+   // pooling of the post processed outputs, see below
+   uint_16 POOL;
+   uint_16 POOL_SIZE;
+   uint_16 POOL_STRIDE;
+   uint_16 POOL_PAD;
+   uint_16 POOL_SCALE;
+   uint_16 POOL_SHIFT;
+
+   uint_16 PRECISION;
+
+   uint_16 SPARSE;
+
+   uint_16 WEIGHT_COMPRESSION;
 };
 
+// Number of uint_16 words in one layer descriptor on Conv's paramsIn, in the
+// order of the Params fields
+#define PARAMS_WORDS 29
+
+// Status word on Conv's status channel, one per layer descriptor. A descriptor whose
+// tiles do not fit in a buffer or table is rejected: the ParamsDeserializer reports
+// the ones it overflows and the layer does not run. The host streams no requantization constants
+// or data for a rejected layer, so it waits for the status before it streams them.
+#define PARAMS_STATUS_OK 0
+#define PARAMS_STATUS_INPUT_BUFFER 1         // N*IX0*IY0*IC1 > INPUT_BUFFER_SIZE
+#define PARAMS_STATUS_WEIGHT_BUFFER 2        // kernel tile rows > WEIGHT_BUFFER_SIZE
+#define PARAMS_STATUS_ACCUMULATION_BUFFER 4  // output tile rows > ACCUMULATION_BUFFER_SIZE
+#define PARAMS_STATUS_POST_PROCESS_TABLE 8   // REQUANTIZE with OC1 > OC1_TABLE_SIZE
+#define PARAMS_STATUS_POOL_BUFFER 16         // open pooled rows > POOL_ROWS or POOL_BUFFER_SIZE
+
+// Batching: a spatial tile holds the same window of all N images, so every
+// weight tile is streamed once per batch instead of once per image, and each
+// (ic1, fx, fy) window in the systolic array runs over N*OY0*OX0 pixels with the
+// same weight_reg. N*IX0*IY0*IC1 has to fit in INPUT_BUFFER_SIZE and N*OY0*OX0 in
+// ACCUMULATION_BUFFER_SIZE, see PARAMS_STATUS_OK. Within a tile the inputs are
+// streamed one channel tile at a time, with the windows of the N images one after
+// the other, and the output rows of a tile come out in (n, oy0, ox0) order.
+
+// Tile loop orders, selected per layer through Params.LOOP_ORDER
+// SPATIAL_OUTER:      OY1/OX1 -> OC1, weights are streamed again for every spatial tile
+// WEIGHT_STATIONARY:  OC1 -> OY1/OX1, each weight tile is streamed once and reused
+//                     across all spatial tiles, inputs are streamed again for every OC1
+#define LOOP_ORDER_SPATIAL_OUTER 0
+#define LOOP_ORDER_WEIGHT_STATIONARY 1
+
+// Convolution modes, selected per layer through Params.CONV_MODE
+// DENSE:      the array reduces over IC0, one (ic1, fx, fy) window at a time
+// DEPTHWISE:  channel c only sees input channel c. Column j of the array is channel
+//             oc1*OC0+j and row i is filter tap fx = i, the input lane j is broadcast
+//             down column j and the array reduces over FX; the FY rows of the filter
+//             are accumulated as FY windows that each stream the N*OY0 input rows of
+//             the tile. Needs IC0 == OC0, IC1 == OC1 and FX <= IC0, the weights of a
+//             kernel tile are FY*FX rows of OC0 values and FX of the IC0 rows are busy.
+// GEMM:       1x1 convolution as a matrix multiply, M = N*OY*OX rows in tiles of
+//             N*OY0*OX0 rows and K = IC1*IC0. Needs FX == FY == 1, STRIDE == 1 and no
+//             padding, so an input tile is read back contiguously, and the systolic
+//             array runs all windows of the layer back to back instead of draining
+//             after every tile.
+// WINOGRAD:   F(2x2, 3x3) for 3x3 stride 1 layers, 4 instead of 9 multiplies per
+//             output. The tile is split into 2x2 output patches with 4x4 input
+//             patches d, which the input buffer sends one channel tile at a time.
+//             WinogradInputTransform (Winograd.h) turns them into V = B^T d B, and the
+//             array runs one window per transformed position, WINOGRAD_POSITIONS per
+//             channel tile, over the N*OY0/2*OX0/2 patches and into accumulation
+//             buffer rows of its own. The weights arrive pre-transformed, U = G' g G'^T
+//             with the integer G' = 2G, and WinogradOutputTransform gives the outputs
+//             (A^T M A) / 4 from the accumulated positions M, exact as long as 4x the
+//             accumulators fits in OUTPUT_PRECISION. Needs FX == FY == 3, STRIDE == 1,
+//             even OY0 and OX0, PRECISION INT8 and no SPARSE, 4*N*OY0*OX0 has to fit
+//             in ACCUMULATION_BUFFER_SIZE. A kernel tile is IC1*WINOGRAD_POSITIONS*IC0
+//             rows of OC0 transformed weights, in (ic1, position, ic0) order, and every
+//             row is streamed as the low bytes of its weights followed by the high bytes.
+#define CONV_MODE_DENSE 0
+#define CONV_MODE_DEPTHWISE 1
+#define CONV_MODE_GEMM 2
+#define CONV_MODE_WINOGRAD 3
+#define WINOGRAD_TILE 4  // input patch and transformed tile size
+#define WINOGRAD_POSITIONS (WINOGRAD_TILE * WINOGRAD_TILE)
+
+// Input and weight precision, selected per layer through Params.PRECISION
+// INT8:  every input_serial / weight_serial value is one int8 channel
+// INT4:  every value packs two int4 channels, bits [3:0] channel 2i and bits [7:4]
+//        channel 2i+1 of input lane (weight row) i, and each PE does the two 4x4
+//        MACs of a value per cycle. IC0 lanes then carry 2*IC0 input channels, a
+//        layer with C input channels needs IC1 = C/(2*IC0) and half the input and
+//        weight traffic, buffer space and array steps of the int8 layer. The double
+//        buffers move the packed values unchanged, the accumulators and outputs are
+//        the same as for INT8. Needs CONV_MODE DENSE or GEMM.
+#define PRECISION_INT8 0
+#define PRECISION_INT4 1
+
+// 2:4 structured weight sparsity, selected per layer through Params.SPARSE: of every
+// group of 4 consecutive input channels at most 2 have a nonzero weight for an output
+// channel. A window then covers the 2*IC0 input channels of channel tiles 2*ic1 and
+// 2*ic1+1, which the input buffer reads together and sends on input and input_hi.
+// Row i of the array holds the weights of slot i, the 2 slots of group i/2 are its 2
+// nonzero weights (zero filled), each with a 2 bit index of its channel in the group.
+// A row carries the 4 inputs of its group and the PE selects the one of its index,
+// so a sparse layer takes IC1/2 windows per tile and 5/8 of the weight buffer.
+// On weight_serial a window is IC0/4 blocks of an index row, whose value j packs the
+// indices of the 4 slots of column j (slot k of the block in bits [2k+1:2k]),
+// followed by the 4 slot rows. Needs an even IC1, CONV_MODE DENSE or GEMM and
+// PRECISION INT8.
+#define SPARSE_GROUP 4
+#define SPARSE_INDEX_PRECISION 2
+
+// Build the array for sparse layers (Params.SPARSE): the skew FIFOs and input registers
+// of every row carry the SPARSE_GROUP inputs of its group, 4x the dense input path, and
+// each PE selects one. Off by default, a dense build carries one input per row and takes
+// no sparse layers; must match SPARSE_ARRAY in scripts/common.tcl
+#ifndef SPARSE_ARRAY
+#define SPARSE_ARRAY 0
+#endif
+#if SPARSE_ARRAY
+#define ARRAY_INPUT_GROUP SPARSE_GROUP
+#else
+#define ARRAY_INPUT_GROUP 1
+#endif
+
+// Weight stream format, selected per layer through Params.WEIGHT_COMPRESSION
+// NONE:       every weight buffer row is OC0 values on weight_serial
+// ZERO_MASK:  every weight buffer row is OC0/8 mask bytes, bit j of byte b set for a
+//             nonzero value in column 8*b+j, followed by the nonzero values of the row
+//             in column order. Rows follow each other without alignment to the packets
+//             and the last packet of a kernel tile is zero padded. The
+//             WeightDoubleBufferWriter expands the rows, so the weight buffer and the
+//             array see the same rows as with NONE.
+#define WEIGHT_COMPRESSION_NONE 0
+#define WEIGHT_COMPRESSION_ZERO_MASK 1
+
+// Zero activation gating: when all inputs of an array row are zero for a pixel (the
+// int8 value, both int4 channels, or the 4 inputs of a sparse row), the row's OC0
+// PEs skip their MACs and pass the psum on. The zero flag is taken at the end of the
+// skew FIFOs and travels along the row with the inputs. Conv's skipped_macs carries
+// the number of skipped MACs of every layer, one word after its last array run.
+// Depthwise layers broadcast the inputs down the columns and are not gated.
+
+// Multi-core: ARRAY_CORES systolic arrays side by side, each with its own weight buffer.
+// Kernel tile oc1 runs on core oc1 % ARRAY_CORES, so a group of ARRAY_CORES consecutive
+// kernel tiles runs at the same time: the input buffer reads the windows of a tile once
+// per group and broadcasts them to the cores of the group (depthwise kernel tiles read
+// their own input channels and get a copy each), the weight buffer writer hands every
+// kernel tile to the buffer of its core, and the output tiles of the cores are merged
+// back into one stream before post processing. In WEIGHT_STATIONARY order the inputs
+// are streamed once per group instead of once per kernel tile and the output tiles of
+// a group come out in (oy1, ox1, oc1) order, see OutputTileCursor in Pooler.h.
+
+// Output post processing, selected per layer through Params.RESIDUAL, Params.RELU and
+// Params.REQUANTIZE, applied in that order
+// RESIDUAL:    acc += shortcut << RESIDUAL_SHIFT, the int8 shortcut (e.g. the block input
+//              of a ResNet basic block) arrives on Conv's residual_serial in the order of
+//              the outputs: per output tile N*OY0*OX0 rows of OC0 channels, packed like
+//              input_serial with the last packet of a tile zero padded. Nothing is read
+//              from residual_serial for a layer without RESIDUAL.
+// RELU:        negative outputs are set to 0
+// REQUANTIZE:  out = saturate_int8((acc + bias[oc]) * scale[oc] >> shift[oc]), rounded to
+//              nearest; every output word then carries 4 int8 channels, the same packing
+//              as input_serial. The descriptor is followed by OC1*OC0 entries of
+//              POST_PROCESS_WORDS words: bias[15:0], bias[31:16], scale, shift.
+#define POST_PROCESS_WORDS 4
+#define POST_PROCESS_SCALE_PRECISION 16
+#define POST_PROCESS_SHIFT_PRECISION 6
+
+// Pooling after post processing, selected per layer through Params.POOL, over
+// POOL_SIZE x POOL_SIZE windows with POOL_STRIDE and POOL_PAD on every side
+// MAX:  maximum of the window positions inside the conv output
+// AVG:  round(sum * POOL_SCALE / 2^POOL_SHIFT) over the positions inside the conv
+//       output, POOL_SCALE = 2^POOL_SHIFT / POOL_SIZE^2 gives the average with the
+//       padding counted as zeros, e.g. POOL_SIZE = OY0 = OX0 for a global average pool
+// Needs POOL_SIZE <= 2*POOL_STRIDE and POOL_PAD < POOL_STRIDE. Output tile t then
+// carries the pooled outputs whose window ends in conv tile t, in (n, py, px) order,
+// see Pooler.h. The windows still open across tiles are kept for POOL_ROWS pooled
+// rows per kernel tile and image, OC1*N*POOL_ROWS/2*ceil(pooled width/2) has to fit
+// in POOL_BUFFER_SIZE, see PARAMS_STATUS_POOL_BUFFER.
+#define POOL_NONE 0
+#define POOL_MAX 1
+#define POOL_AVG 2
+#define POOL_SCALE_PRECISION 16
+#define POOL_SHIFT_PRECISION 5
+
+// Rows (IC0, input channels) and columns (OC0, output channels) of the systolic
+// array, square by default. Layers are tiled with IC0 = ARRAY_IC0, OC0 = ARRAY_OC0;
+// OC0 has to be a multiple of 8, and depthwise layers need a square array.
+#ifndef ARRAY_DIMENSION
 #define ARRAY_DIMENSION 16
-#define REPEAT(x) BOOST_PP_REPEAT(ARRAY_DIMENSION, x, 0)
+#endif
+#ifndef ARRAY_IC0
+#define ARRAY_IC0 ARRAY_DIMENSION
+#endif
+#ifndef ARRAY_OC0
+#define ARRAY_OC0 ARRAY_DIMENSION
+#endif
+// the skew FIFOs of the rows and of the columns of the array
+#define REPEAT_IC0(x) BOOST_PP_REPEAT(ARRAY_IC0, x, 0)
+#define REPEAT_OC0(x) BOOST_PP_REPEAT(ARRAY_OC0, x, 0)
 
 #define INPUT_PRECISION 8
 #define WEIGHT_PRECISION 8
 #define OUTPUT_PRECISION (4*INPUT_PRECISION)
 
+// Build the array for Winograd layers (Params.CONV_MODE WINOGRAD): a transformed input
+// is a sum of 4 inputs and a transformed weight a sum of up to 9 weights times 4, so
+// the array takes 2 more input and 4 more weight bits than the layer data. Off by
+// default, must match WINOGRAD in scripts/common.tcl
+#ifndef WINOGRAD
+#define WINOGRAD 0
+#endif
+#if WINOGRAD
+#define ARRAY_INPUT_PRECISION (INPUT_PRECISION+2)
+#define ARRAY_WEIGHT_PRECISION (WEIGHT_PRECISION+4)
+#else
+#define ARRAY_INPUT_PRECISION INPUT_PRECISION
+#define ARRAY_WEIGHT_PRECISION WEIGHT_PRECISION
+#endif
+
 #define INPUT_BUFFER_SIZE  4096 // Input buffer size per IC0 per bank
 #define WEIGHT_BUFFER_SIZE 8192 // Weight buffer size per OC0 per bank
-#define ACCUMULATION_BUFFER_SIZE 256
+// Accumulation buffer rows per systolic array core, the output rows of a tile, also
+// the depth of the output serializer banks. Catapult splits it into banks of
+// ACCUMULATION_BANK_SIZE rows (scripts/common.tcl), 1024 rows take 28x28 tiles.
+#ifndef ACCUMULATION_BUFFER_SIZE
+#define ACCUMULATION_BUFFER_SIZE 1024
+#endif
+#define POOL_BUFFER_SIZE 512 // Pooling buffer size per bank, 4 banks
+#define POOL_ROWS 8          // Pooled rows kept per kernel tile and image, power of 2
+
+// Values per packet on Conv's input_serial and weight_serial (4/8/16/32), match it to the
+// memory fabric width; with more lanes than ARRAY_IC0 (ARRAY_OC0) a packet carries several rows
+#ifndef SERIAL_LANES
+#define SERIAL_LANES 4
+#endif
+#if (ARRAY_IC0 % SERIAL_LANES != 0 && SERIAL_LANES % ARRAY_IC0 != 0) || \
+    (ARRAY_OC0 % SERIAL_LANES != 0 && SERIAL_LANES % ARRAY_OC0 != 0)
+#error "SERIAL_LANES must divide ARRAY_IC0 and ARRAY_OC0 or be a multiple of them"
+#endif
+
+// Words per beat on Conv's output_serial, divides ARRAY_OC0 (4/8/16)
+#ifndef OUTPUT_LANES
+#define OUTPUT_LANES ARRAY_OC0
+#endif
+#if ARRAY_OC0 % OUTPUT_LANES != 0
+#error "OUTPUT_LANES must divide ARRAY_OC0"
+#endif
+// a requantized output word packs 4 int8 channels, see REQUANTIZE
+#if ARRAY_OC0 % 4 != 0
+#error "ARRAY_OC0 must be a multiple of 4"
+#endif
+
+// Systolic array cores, see Multi-core above
+#ifndef ARRAY_CORES
+#define ARRAY_CORES 1
+#endif
+
+// Feed the next (ic1, fx, fy) window into the systolic array while the previous one drains
+#ifndef CONTINUOUS_STREAMING
+#define CONTINUOUS_STREAMING 1
+#endif
+
+// C simulation only: replace SystolicArrayCore with a bit-exact GEMM model (SystolicArrayFunctional.h)
+#ifndef SYSTOLIC_ARRAY_FUNCTIONAL
+#define SYSTOLIC_ARRAY_FUNCTIONAL 0
+#endif
 
 typedef ac_int<INPUT_PRECISION,true> IDTYPE; 
 typedef ac_int<WEIGHT_PRECISION,true> WDTYPE; 
 typedef ac_int<OUTPUT_PRECISION,true> ODTYPE; 
+// operands of the processing elements
+typedef ac_int<ARRAY_INPUT_PRECISION,true> ARRAY_IDTYPE;
+typedef ac_int<ARRAY_WEIGHT_PRECISION,true> ARRAY_WDTYPE;
+
+// Post processing constants of the OC0 output channels of one kernel tile
+template <int OC0>
+struct PostProcessRow {
+  PackedInt<OUTPUT_PRECISION, OC0> bias;
+  PackedInt<POST_PROCESS_SCALE_PRECISION, OC0> scale;
+  ac_int<POST_PROCESS_SHIFT_PRECISION, false> shift[OC0];
+};
+
+// Pixels of one window in the systolic array, a Winograd window runs over the 2x2
+// output patches of the tile
+inline uint_16 window_pixels(const Params &params)
+{
+    if (params.CONV_MODE == CONV_MODE_WINOGRAD) {
+        return params.N * (params.OY0 / 2) * (params.OX0 / 2);
+    }
+    return params.N * params.OY0 * params.OX0;
+}
+
+// Rows of an output tile as they leave the systolic array, a Winograd tile leaves as
+// the transformed positions of its patches, see Params.CONV_MODE
+inline uint_16 array_tile_rows(const Params &params)
+{
+    if (params.CONV_MODE == CONV_MODE_WINOGRAD) {
+        return WINOGRAD_POSITIONS * window_pixels(params);
+    }
+    return params.N * params.OY0 * params.OX0;
+}
+
+// Groups of cores consecutive kernel tiles of a layer, one runs at a time
+inline uint_16 kernel_tile_groups(const Params &params, int cores)
+{
+    return (params.OC1 + cores - 1) / cores;
+}
+
+// The part of a layer that runs on core: kernel tiles core, core + cores, ..., none
+// for core >= OC1. The core sees them as a layer with fewer kernel tiles.
+inline Params core_params(const Params &params, int core, int cores)
+{
+    Params result = params;
+    result.OC1 = (params.OC1 + cores - 1 - core) / cores;
+    return result;
+}
 
 
 // Max values for resnet-18
@@ -76,5 +393,9 @@ typedef ac_int<OUTPUT_PRECISION,true> ODTYPE;
 #define IX0_MAX ((OX0_MAX-1)*STRIDE_MAX+FX_MAX)
 #define IY0_MAX ((OY0_MAX-1)*STRIDE_MAX+FY_MAX)
 
+// Kernel tiles of requantization constants the PostProcessor holds: the resnet-18
+// output channels over the array columns
+#define OC1_TABLE_SIZE ((OC1_MAX*OC0_MAX+ARRAY_OC0-1)/ARRAY_OC0)
+
 #endif
 
@@ -1,16 +1,19 @@
 template <typename IDTYPE, 
-          typename ODTYPE,
-          int OFMAP_HEIGHT, 
-          int OFMAP_WIDTH, 
-          int OFMAP_CHANNELS, 
-          int IFMAP_CHANNELS, 
-          int FILTER_SIZE, 
-          int STRIDE>
-void conv_gold( IDTYPE ifmap[(OFMAP_HEIGHT-1)*STRIDE+FILTER_SIZE][(OFMAP_WIDTH-1)*STRIDE+FILTER_SIZE][IFMAP_CHANNELS],
-               IDTYPE weights[FILTER_SIZE][FILTER_SIZE][IFMAP_CHANNELS][OFMAP_CHANNELS],
-               ODTYPE ofmap[OFMAP_HEIGHT][OFMAP_WIDTH][OFMAP_CHANNELS]){
-
+          typename ODTYPE>
+void conv_gold( int OFMAP_HEIGHT, 
+                int OFMAP_WIDTH, 
+                int OFMAP_CHANNELS, 
+                int IFMAP_CHANNELS, 
+                int FILTER_SIZE, 
+                int STRIDE,
+                // [(OFMAP_HEIGHT-1)*STRIDE+FILTER_SIZE][(OFMAP_WIDTH-1)*STRIDE+FILTER_SIZE][IFMAP_CHANNELS]
+                const IDTYPE *ifmap,
+                // [FILTER_SIZE][FILTER_SIZE][IFMAP_CHANNELS][OFMAP_CHANNELS]
+                const IDTYPE *weights,
+                // [OFMAP_HEIGHT][OFMAP_WIDTH][OFMAP_CHANNELS]
+                ODTYPE *ofmap){
 
+  const int IFMAP_WIDTH = (OFMAP_WIDTH-1)*STRIDE+FILTER_SIZE;
 
   OY: for (int oy = 0; oy < OFMAP_HEIGHT; oy++) {
     OX: for (int ox = 0; ox < OFMAP_WIDTH; ox++) {
@@ -19,12 +22,117 @@ void conv_gold( IDTYPE ifmap[(OFMAP_HEIGHT-1)*STRIDE+FILTER_SIZE][(OFMAP_WIDTH-1
         IC: for (int ic = 0; ic < IFMAP_CHANNELS; ic++) { 
           FX: for (int fx = 0; fx < FILTER_SIZE; fx++) {
             FY: for (int fy = 0; fy < FILTER_SIZE; fy++) {
-              tmp += (int32_t) ifmap[STRIDE*oy+fy][STRIDE*ox+fx][ic] * 
-                     (int32_t) weights[fy][fx][ic][oc];
+              tmp += (int32_t) ifmap[((STRIDE*oy+fy)*IFMAP_WIDTH + STRIDE*ox+fx)*IFMAP_CHANNELS + ic] * 
+                     (int32_t) weights[((fy*FILTER_SIZE + fx)*IFMAP_CHANNELS + ic)*OFMAP_CHANNELS + oc];
             }
           }
         }
-        ofmap[oy][ox][oc]= tmp; 
+        ofmap[(oy*OFMAP_WIDTH + ox)*OFMAP_CHANNELS + oc]= tmp; 
+      }
+    }
+  }
+}
+
+// Residual add applied in place to the conv_gold result before post processing,
+// see Params.RESIDUAL in conv.h
+template <typename IDTYPE, typename ODTYPE>
+void residual_add_gold( int OFMAP_HEIGHT, 
+                        int OFMAP_WIDTH, 
+                        int OFMAP_CHANNELS, 
+                        int residual_shift,
+                        // [OFMAP_HEIGHT][OFMAP_WIDTH][OFMAP_CHANNELS]
+                        const IDTYPE *residual,
+                        // [OFMAP_HEIGHT][OFMAP_WIDTH][OFMAP_CHANNELS]
+                        ODTYPE *ofmap){
+
+  for (int i = 0; i < OFMAP_HEIGHT * OFMAP_WIDTH * OFMAP_CHANNELS; i++) {
+    // wraps around like the 32 bit accumulators
+    int64_t shortcut = (int64_t) (int) residual[i] * ((int64_t) 1 << residual_shift);
+    ofmap[i] = (int32_t) (uint32_t) ((int64_t) (int32_t) ofmap[i] + shortcut);
+  }
+}
+
+// Output post processing applied in place to the conv_gold result, see
+// Params.RELU / Params.REQUANTIZE in conv.h
+template <typename ODTYPE>
+void post_process_gold( int OFMAP_HEIGHT, 
+                        int OFMAP_WIDTH, 
+                        int OFMAP_CHANNELS, 
+                        bool relu,
+                        bool requantize,
+                        // [OFMAP_CHANNELS]
+                        const int32_t *bias,
+                        const int32_t *scale,
+                        const int32_t *shift,
+                        // [OFMAP_HEIGHT][OFMAP_WIDTH][OFMAP_CHANNELS]
+                        ODTYPE *ofmap){
+
+  for (int i = 0; i < OFMAP_HEIGHT * OFMAP_WIDTH; i++) {
+    for (int oc = 0; oc < OFMAP_CHANNELS; oc++) {
+      int64_t tmp = (int32_t) ofmap[i*OFMAP_CHANNELS + oc];
+      if (requantize) {
+        tmp = (tmp + bias[oc]) * scale[oc];
+        if (shift[oc] != 0) {
+          tmp = (tmp + ((int64_t) 1 << (shift[oc] - 1))) >> shift[oc];
+        }
+        tmp = tmp > 127 ? 127 : (tmp < -128 ? -128 : tmp);
+      }
+      if (relu && tmp < 0) {
+        tmp = 0;
+      }
+      ofmap[i*OFMAP_CHANNELS + oc] = tmp;
+    }
+  }
+}
+
+// Pooling of the post processed conv_gold result, see Params.POOL in conv.h
+template <typename ODTYPE>
+void pool_gold( int OFMAP_HEIGHT, 
+                int OFMAP_WIDTH, 
+                int OFMAP_CHANNELS, 
+                int pool,
+                int pool_size,
+                int pool_stride,
+                int pool_pad,
+                int pool_scale,
+                int pool_shift,
+                // [OFMAP_HEIGHT][OFMAP_WIDTH][OFMAP_CHANNELS]
+                const ODTYPE *ofmap,
+                // [POOLED_HEIGHT][POOLED_WIDTH][OFMAP_CHANNELS]
+                ODTYPE *pooled){
+
+  int POOLED_HEIGHT = (OFMAP_HEIGHT + 2 * pool_pad - pool_size) / pool_stride + 1;
+  int POOLED_WIDTH = (OFMAP_WIDTH + 2 * pool_pad - pool_size) / pool_stride + 1;
+  for (int py = 0; py < POOLED_HEIGHT; py++) {
+    for (int px = 0; px < POOLED_WIDTH; px++) {
+      for (int oc = 0; oc < OFMAP_CHANNELS; oc++) {
+        int32_t tmp = 0;
+        bool first = true;
+        for (int y = py * pool_stride - pool_pad; y < py * pool_stride - pool_pad + pool_size; y++) {
+          for (int x = px * pool_stride - pool_pad; x < px * pool_stride - pool_pad + pool_size; x++) {
+            if (y < 0 || y >= OFMAP_HEIGHT || x < 0 || x >= OFMAP_WIDTH) {
+              continue;
+            }
+            int32_t value = (int32_t) ofmap[(y*OFMAP_WIDTH + x)*OFMAP_CHANNELS + oc];
+            if (first) {
+              tmp = value;
+            } else if (pool == POOL_MAX) {
+              tmp = std::max(tmp, value);
+            } else {
+              // wraps around like the 32 bit accumulators
+              tmp = (int32_t) ((uint32_t) tmp + (uint32_t) value);
+            }
+            first = false;
+          }
+        }
+        if (pool == POOL_AVG) {
+          int64_t scaled = (int64_t) tmp * pool_scale;
+          if (pool_shift != 0) {
+            scaled += (int64_t) 1 << (pool_shift - 1);
+          }
+          tmp = (int32_t) (uint32_t) (scaled >> pool_shift);
+        }
+        pooled[(py*POOLED_WIDTH + px)*OFMAP_CHANNELS + oc] = tmp;
       }
     }
   }
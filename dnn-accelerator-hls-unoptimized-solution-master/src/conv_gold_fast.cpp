@@ -0,0 +1,91 @@
+#include <stdint.h>
+#include <vector>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Dot product of two int16 vectors of length n (a multiple of 16), wrapping at 32 bits
+inline int32_t conv_gold_dot(const int16_t *a, const int16_t *b, int n) {
+  int i = 0;
+  uint32_t tmp = 0;
+#ifdef __AVX2__
+  __m256i sum = _mm256_setzero_si256();
+  for (; i + 16 <= n; i += 16) {
+    __m256i av = _mm256_loadu_si256((const __m256i *) &a[i]);
+    __m256i bv = _mm256_loadu_si256((const __m256i *) &b[i]);
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(av, bv));
+  }
+  int32_t lanes[8];
+  _mm256_storeu_si256((__m256i *) lanes, sum);
+  for (int l = 0; l < 8; l++) {
+    tmp += (uint32_t) lanes[l];
+  }
+#endif
+  for (; i < n; i++) {
+    tmp += (uint32_t) ((int32_t) a[i] * (int32_t) b[i]);
+  }
+  return (int32_t) tmp;
+}
+
+// Same result as conv_gold, with the ac_int tensors widened to native int16 so that
+// the IC reduction is a SIMD dot product, and the OY rows split across threads
+template <typename IDTYPE,
+          typename ODTYPE>
+void conv_gold_fast( int OFMAP_HEIGHT,
+                     int OFMAP_WIDTH,
+                     int OFMAP_CHANNELS,
+                     int IFMAP_CHANNELS,
+                     int FILTER_SIZE,
+                     int STRIDE,
+                     const IDTYPE *ifmap,
+                     const IDTYPE *weights,
+                     ODTYPE *ofmap){
+
+  const int IFMAP_HEIGHT = (OFMAP_HEIGHT-1)*STRIDE+FILTER_SIZE;
+  const int IFMAP_WIDTH = (OFMAP_WIDTH-1)*STRIDE+FILTER_SIZE;
+  // channels padded with zeros to a multiple of 16
+  const int IC_PAD = (IFMAP_CHANNELS + 15) / 16 * 16;
+
+  // ifmap as [IY][IX][IC], weights transposed to [FY][FX][OC][IC]
+  std::vector<int16_t> in((size_t) IFMAP_HEIGHT * IFMAP_WIDTH * IC_PAD, 0);
+  std::vector<int16_t> w((size_t) FILTER_SIZE * FILTER_SIZE * OFMAP_CHANNELS * IC_PAD, 0);
+
+  for (int iy = 0; iy < IFMAP_HEIGHT; iy++) {
+    for (int ix = 0; ix < IFMAP_WIDTH; ix++) {
+      for (int ic = 0; ic < IFMAP_CHANNELS; ic++) {
+        in[((size_t) iy * IFMAP_WIDTH + ix) * IC_PAD + ic] = (int16_t) ifmap[((size_t) iy * IFMAP_WIDTH + ix) * IFMAP_CHANNELS + ic].to_int();
+      }
+    }
+  }
+  for (int fy = 0; fy < FILTER_SIZE; fy++) {
+    for (int fx = 0; fx < FILTER_SIZE; fx++) {
+      for (int ic = 0; ic < IFMAP_CHANNELS; ic++) {
+        for (int oc = 0; oc < OFMAP_CHANNELS; oc++) {
+          w[(((size_t) fy * FILTER_SIZE + fx) * OFMAP_CHANNELS + oc) * IC_PAD + ic] = (int16_t) weights[(((size_t) fy * FILTER_SIZE + fx) * IFMAP_CHANNELS + ic) * OFMAP_CHANNELS + oc].to_int();
+        }
+      }
+    }
+  }
+
+  #pragma omp parallel for schedule(dynamic)
+  for (int oy = 0; oy < OFMAP_HEIGHT; oy++) {
+    std::vector<uint32_t> acc(OFMAP_CHANNELS);
+    for (int ox = 0; ox < OFMAP_WIDTH; ox++) {
+      for (int oc = 0; oc < OFMAP_CHANNELS; oc++) {
+        acc[oc] = 0;
+      }
+      for (int fy = 0; fy < FILTER_SIZE; fy++) {
+        for (int fx = 0; fx < FILTER_SIZE; fx++) {
+          const int16_t *pixel = &in[((size_t) (STRIDE*oy+fy) * IFMAP_WIDTH + STRIDE*ox+fx) * IC_PAD];
+          const int16_t *filter = &w[((size_t) fy * FILTER_SIZE + fx) * OFMAP_CHANNELS * IC_PAD];
+          for (int oc = 0; oc < OFMAP_CHANNELS; oc++) {
+            acc[oc] += (uint32_t) conv_gold_dot(pixel, filter + (size_t) oc * IC_PAD, IC_PAD);
+          }
+        }
+      }
+      for (int oc = 0; oc < OFMAP_CHANNELS; oc++) {
+        ofmap[((size_t) oy * OFMAP_WIDTH + ox) * OFMAP_CHANNELS + oc] = (int32_t) acc[oc];
+      }
+    }
+  }
+}
@@ -1,13 +1,8 @@
 template <typename IDTYPE,
-	  typename ODTYPE,
-           int OFMAP_HEIGHT, 
-          int OFMAP_WIDTH, 
-          int OFMAP_CHANNELS, 
-          int IFMAP_CHANNELS, 
-          int FILTER_SIZE, 
-          int STRIDE>
+	  typename ODTYPE>
 
 void conv_gold_tiled( 
+          int STRIDE, 
 	  int OY1, 
 	  int OY0, 
           int OX1, 
@@ -18,17 +13,23 @@ void conv_gold_tiled(
           int IC0, 
           int FX, 
           int FY, 
-	       IDTYPE ifmap[(OFMAP_HEIGHT-1)*STRIDE+FILTER_SIZE][(OFMAP_WIDTH-1)*STRIDE+FILTER_SIZE][IFMAP_CHANNELS],
-               IDTYPE weights[FILTER_SIZE][FILTER_SIZE][IFMAP_CHANNELS][OFMAP_CHANNELS],
-               ODTYPE ofmap[OFMAP_HEIGHT][OFMAP_WIDTH][OFMAP_CHANNELS]
+	       const IDTYPE *ifmap,
+               const IDTYPE *weights,
+               ODTYPE *ofmap
 		)
 
 
 {
+  // Same flattened layouts as conv_gold
+  const int IFMAP_WIDTH = (OX1*OX0-1)*STRIDE+FX;
+  const int IFMAP_CHANNELS = IC1*IC0;
+  const int OFMAP_WIDTH = OX1*OX0;
+  const int OFMAP_CHANNELS = OC1*OC0;
+
   OY: for (int oy = 0; oy < OY1*OY0; oy++) {
     OX: for (int ox = 0; ox < OX1*OX0; ox++) {
       OC: for (int oc = 0; oc < OC1*OC0; oc++) {
-        ofmap[oy][ox][oc] = 0;
+        ofmap[(oy*OFMAP_WIDTH + ox)*OFMAP_CHANNELS + oc] = 0;
       }
     }
   }
@@ -50,9 +51,9 @@ void conv_gold_tiled(
                     IC0: for (int ic0 = 0; ic0 < IC0; ic0++) { 
                       // In hardware this loop is unrolled
                       int ic = ic1*IC0 + ic0;
-                      ofmap[oy][ox][oc] += 
-                        (int32_t) ifmap[STRIDE*oy+fy][STRIDE*ox+fx][ic] * 
-                        (int32_t) weights[fy][fx][ic][oc];
+                      ofmap[(oy*OFMAP_WIDTH + ox)*OFMAP_CHANNELS + oc] += 
+                        (int32_t) ifmap[((STRIDE*oy+fy)*IFMAP_WIDTH + STRIDE*ox+fx)*IFMAP_CHANNELS + ic] * 
+                        (int32_t) weights[((fy*FX + fx)*IFMAP_CHANNELS + ic)*OFMAP_CHANNELS + oc];
                       
                     }
 
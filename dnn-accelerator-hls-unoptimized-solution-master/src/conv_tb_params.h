@@ -9,3 +9,23 @@ const int OY0 = 7;
 const int OX1 = 4;
 const int OY1 = 4;
 const int STRIDE = 2; 
+const int LOOP_ORDER = 0;
+const int RELU = 0;
+const int REQUANTIZE = 0;
+const int PAD_TOP = 0;
+const int PAD_BOTTOM = 0;
+const int PAD_LEFT = 0;
+const int PAD_RIGHT = 0;
+const int N = 1;
+const int CONV_MODE = 0;
+const int RESIDUAL = 0;
+const int RESIDUAL_SHIFT = 0;
+const int POOL = 0;
+const int POOL_SIZE = 1;
+const int POOL_STRIDE = 1;
+const int POOL_PAD = 0;
+const int POOL_SCALE = 32768;
+const int POOL_SHIFT = 15;
+const int PRECISION = 0;
+const int SPARSE = 0;
+const int WEIGHT_COMPRESSION = 0;